@@ -25,6 +25,7 @@ inline bool Valid(Request const& r) {
 
 struct PrefetchedRequest : Request {
     double value;
+    size_t distance;  //of an association: its typical distance after the source (as predictor's time stamps), zero if unknown
 };
 
 inline bool operator<(PrefetchedRequest const& l, PrefetchedRequest const& r) {
@@ -50,8 +50,16 @@ public:
     virtual ~ICache() = default;
 
     virtual Response Write(const Request&) = 0;
-    virtual Response Read(const Request&, std::function<void(const Request&)> on_prediction = nullptr) = 0;
-    virtual Response Prefetch(const Request&) = 0;
+    // 'on_prediction' gets an association, its source request and its typical distance after the source (zero if unknown)
+    virtual Response Read(const Request&, std::function<void(const Request&, const Request&, size_t)> on_prediction = nullptr) = 0;
+    // reads 'count' requests at once writing their responses to 'out'
+    virtual void ReadBatch(const Request* reqs, size_t count, Response* out,
+                           std::function<void(const Request&, const Request&, size_t)> on_prediction = nullptr) {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = Read(reqs[i], on_prediction);
+    }
+    // 'source' is the request the prefetched one is associated with (if any), the predictor gets feedback on it
+    virtual Response Prefetch(const Request&, const Request& source = {}) = 0;
 };
 
 /* Type of cache (eviction) */
@@ -2,11 +2,13 @@
 
 #include <common.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <functional>
 #include <memory>
 #include <optional>
+#include <string>
 #include <vector>
 
 enum PredictorAlgo {
@@ -15,19 +17,41 @@ enum PredictorAlgo {
     PredictorAlgoLookAhead = 2u
 };
 
+// What the predictor does w/ notifications of a subscriber whose queue is full
+enum NotifyOverflow {
+    NotifyOverflowDrop = 0u,     //new notifications are lost
+    NotifyOverflowCoalesce = 1u  //new notifications are kept aside, ones of the same request are merged
+};
+
+// Which prediction is replaced when the prefetch table is full
+enum PredictionEviction {
+    PredictionEvictionOldest = 0u,  //the oldest one
+    PredictionEvictionClock = 1u    //CLOCK w/ use counters, predictions w/o recent hits go first
+};
+
 struct PredictorParams {
     // params for Mithril work
-    size_t lookahead_range;
+    size_t lookahead_range;  // in references or, for 'TimeStamp::DoubleTime', in time stamp units (e.g. usec)
     size_t max_support;
     size_t min_support;
     size_t confidence;
     size_t pf_list_size;
     bool is_priority_queue;
+    // depth of association chains followed by queries (zero or one means direct associations only),
+    // associations of a query are limited by 'pf_list_size * dfs'
     size_t dfs;
+    PredictionEviction prediction_eviction;
+    // N > 0 bytes: a query of a request which doesn't start as any prediction gets associations of predictions
+    // whose ranges overlap it (e.g. a read inside a learned range), they are found by aligned blocks of N bytes
+    size_t overlap_block_size;
 
     TimeStamp ts_type;
     Metrics associations_metrics_type;
 
+    // N > 1 bytes: requests are keyed by aligned blocks of N bytes (e.g. a block, a page or a shard's chunk) on entry,
+    // so ones of the same block are the same request and associations are whole blocks; zero keeps byte addresses
+    size_t key_granularity;
+
     // params for RequestSizeUpdatePolicy
     RequestSizeUpdatePolicy req_size_update_policy;
     size_t limit_size_for_size_policy;
@@ -37,10 +61,33 @@ struct PredictorParams {
     size_t prefetch_table_num_rows;
     size_t record_table_num_rows;
 
-    //zero assumes single threaded
+    // zero mines the whole mining table at once when it's full, N > 0 mines (up to) N oldest requests
+    // whose lookahead window has passed every N requests moved to mining table, others wait for the next rounds
+    size_t mining_step;
+
+    //zero assumes single threaded, N > 0 is the number of mining threads
     size_t thread_count;
 
+    //num of independently locked partitions of recorded requests (by address) of 'PredictorType::PartitionedDBSP',
+    //zero means the default one
+    size_t partition_count;
+
+    //sightings of a request before it's recorded (counted by a frequency sketch per partition), zero or one records all
+    size_t admission_count;
+
     unsigned algo;  //combination of PredictorMode flags
+
+    // streams tracked by 'PredictorAlgoLookAhead' and max num of requests predicted ahead of a stream,
+    // zero means the default ones
+    size_t stream_count;
+    size_t stream_depth;
+
+    std::string snapshot_path;  //tables are loaded from the snapshot at 'init' if not empty
+
+    // zero notifies subscribers from mining at once, N > 0 queues up to N notifications per subscriber
+    // to be delivered by 'drainNotifications' from subscriber's thread
+    size_t notify_queue_size;
+    NotifyOverflow notify_overflow;
 };
 
 // This is the handle that consumers get after the registering.
@@ -50,6 +97,7 @@ struct IPredictorLink {
 
     // provide data thru this
     // must not block caller thread for a long time
+    // 'timestamp' is used w/ 'TimeStamp::DoubleTime' (zero means 'req.time_' or, if zero too, predictor's monotonic clock)
     virtual int compute(Request req, size_t timestamp = 0) = 0;
 
     // get associated request
@@ -57,10 +105,66 @@ struct IPredictorLink {
     virtual std::optional<Request> getAssociatedRequest(Request req /* source request */, double association_priority = 0) = 0;
 
     virtual std::vector<Request> getAssociatedVectorOfRequests(Request req /* source request */, double association_priority = 0) = 0;
+
+    // get associated requests into caller's buffer of 'capacity' elements w/o allocating, returns the number written
+    // if 'distances' isn't null, 'distances[i]' receives the typical distance of 'out[i]' after 'req'
+    // (as predictor's time stamps: references or, for 'TimeStamp::DoubleTime', time units), zero if unknown
+    virtual size_t getAssociatedRequests(Request req /* source request */, Request* out, size_t capacity, double association_priority = 0,
+                                         size_t* distances = nullptr) {
+        auto a = getAssociatedVectorOfRequests(req, association_priority);
+        auto n = std::min(a.size(), capacity);
+        std::copy_n(std::begin(a), n, out);
+        if (distances)
+            std::fill_n(distances, n, 0);
+        return n;
+    }
+
+    // max number of associations per request (e.g. to size the buffer above), zero if not limited
+    virtual size_t getAssociationsLimit() const {
+        return 0;
+    }
+
+    // provide 'count' requests at once, the predictor may take its locks once per batch
+    virtual int computeBatch(Request const* reqs, size_t count, size_t timestamp = 0) {
+        for (size_t i = 0; i < count; ++i)
+            if (auto r = compute(reqs[i], timestamp))
+                return r;
+
+        return 0;
+    }
+
+    // get associated requests of 'count' requests at once
+    // associations are written to 'out' one request after another (up to 'out_capacity' in total),
+    // 'counts[i]' receives the number of associations written for 'reqs[i]'; returns the total number written
+    // 'distances' (if not null) is parallel to 'out' as in 'getAssociatedRequests'
+    virtual size_t getAssociationsBatch(Request const* reqs, size_t count, Request* out, size_t out_capacity, size_t* counts, size_t* distances = nullptr) {
+        size_t n = 0;
+        for (size_t i = 0; i < count; ++i) {
+            auto a = getAssociatedVectorOfRequests(reqs[i]);
+            counts[i] = std::min(a.size(), out_capacity - n);
+            std::copy_n(std::begin(a), counts[i], out + n);
+            if (distances)
+                std::fill_n(distances + n, counts[i], 0);
+            n += counts[i];
+        }
+
+        return n;
+    }
+
+    // feedback of the cache on a block 'assoc' prefetched as an association of 'src':
+    // it was read ('reportUseful') or evicted w/o reads ('reportWasted'), so the predictor may demote the association
+    virtual void reportUseful(Request /*src*/, Request /*assoc*/) {}
+    virtual void reportWasted(Request /*src*/, Request /*assoc*/) {}
+
+    // delivers up to 'limit' queued notifications of 'owner' (see 'registerLink') to its callback from the caller's thread,
+    // returns the number delivered; a subscriber shall drain from one thread at a time
+    virtual size_t drainNotifications(void* /*owner*/, size_t /*limit*/ = SIZE_MAX) {
+        return 0;
+    }
 };
 
 /* Type of predictor */
-enum class PredictorType { DBSP};
+enum class PredictorType { DBSP, PartitionedDBSP, LookAhead, Mithril };
 
 /* Callback function that is invoked by predictor when associations are ready for request */
 using PredictorNotify = int(Request /* request */, Request const* /* associations */, size_t /* associations count*/);
@@ -80,4 +184,18 @@ struct IPredictor {
     static std::shared_ptr<IPredictor> create(PredictorType, const PredictorParams&);
         // Initializing object by parameters.
     virtual int init(const PredictorParams&) = 0;
+    // Saves predictions (and optionally recorded requests) to the snapshot file to be loaded by 'init'
+    virtual int save(std::string const& /*path*/, bool /*with_records*/ = false) {
+        return -1;
+    }
+    // Returns params of the predictor that fits 'bytes_total_size' bytes of metadata, default constructed params if it can't fit.
+    // The params the predictor is created w/ are kept except the tables' sizes, their zeros take the predictor's defaults
+    virtual PredictorParams get_params(size_t /*bytes_total_size*/) {
+        return {};
+    }
+    // Current time stamp (recorded references or, for 'TimeStamp::DoubleTime', the last time), distances of associations
+    // are measured by it; zero if the predictor doesn't measure distances
+    virtual uint64_t get_time_stamp() const {
+        return 0;
+    }
 };
\ No newline at end of file
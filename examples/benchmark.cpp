@@ -24,7 +24,7 @@ int main(int argc, char* argv[]) {
 
     fs::path input;
     CacheParams cache_par;
-    size_t num_shards, num_requests, skip, max_queue_size, shard_size;
+    size_t num_shards, num_requests, skip, max_queue_size, shard_size, batch_size, prefetch_lead;
     int verbose;
     auto prefetch_policy = PrefetchPolicy::Never;
     auto predictor_type = PredictorType::DBSP;
@@ -34,6 +34,8 @@ int main(int argc, char* argv[]) {
     auto pr_auto_config = false;
     auto preload_trace = false;
     auto sharded_predictor = false;
+    auto snapshot_records = false;
+    auto streams = false;
     auto trace_format = TraceFileFormat::def;
     auto cache_type = CacheType::LRU;
     po::options_description desc("Allowed options");
@@ -50,21 +52,39 @@ int main(int argc, char* argv[]) {
     ("page,P", po::value<>(&cache_par.page_size)->default_value(default_page), "Page size")
     ("block,B",  po::value<>(&cache_par.block_size)->default_value(default_block), "Block size")
     ("verbose,V", po::value<>(&verbose)->default_value(1)->implicit_value(1), "Verbose level")
-    ("predictor", po::value<PredictorType>(&predictor_type), "Predictor type, default is DBSP\nPossible values: \n0) DBSP")
+    ("predictor", po::value<PredictorType>(&predictor_type), "Predictor type, default is DBSP\nPossible values: \n0) DBSP \n1) PartitionedDBSP (recorded requests are split by address into independently locked partitions) \n2) LookAhead (sequential/strided streams w/o mining) \n3) Mithril (baseline of the paper w/ the same table sizes)")
     ("prefetch", po::value<PrefetchPolicy>(&prefetch_policy),  "Prefetch policy, default level is Never\nPossible values: \n0) Never \n1) Always \n2) OnMiss")
     ("lookahead_range", po::value<>(&par.lookahead_range)->default_value(par.lookahead_range), "lookahead_range")
     ("max_support", po::value<>(&par.max_support)->default_value(par.max_support), "max_support")
     ("min_support", po::value<>(&par.min_support)->default_value(par.min_support), "min_support")
     ("pf_list_size", po::value<>(&par.pf_list_size)->default_value(par.pf_list_size), "pf_list_size")
     ("mtable_size", po::value<>(&par.mining_table_num_rows)->default_value(par.mining_table_num_rows), "mining_table_num_rows")
+    ("mining_step", po::value<>(&par.mining_step)->default_value(par.mining_step), "Number of requests mined incrementally once their lookahead window has passed (zero means the whole mining table is mined when it's full)")
+    ("admission_count", po::value<>(&par.admission_count)->default_value(par.admission_count), "Number of recent sightings of a request before it's recorded (zero or one means every request is recorded)")
     ("rtable_size", po::value<>(&par.record_table_num_rows)->default_value(par.record_table_num_rows), "record_table_num_rows, default value for params_cases::OriginalPaperCase is 20e3")
     ("ptable_size", po::value<>(&par.prefetch_table_num_rows)->default_value(par.prefetch_table_num_rows),"prefetch_table_num_rows, default value for ""params_cases::OriginalPaperCase is 30e3")
+    ("ts_type", po::value<TimeStamp>(&par.ts_type), "Time stamps of requests, default is Counter\nPossible values: \n0) Counter (reference number) \n1) Time (trace's r_time, 'lookahead_range' is a time window then)")
+    ("metrics", po::value<Metrics>(&par.associations_metrics_type), "Associations' scoring metrics, default is OriginalPaper\nPossible values: \n0) OriginalPaper \n1) Module \n2) NormalizedModul \n3) MinModul \n4) Square \n5) NormalizedSquare \n6) MinSquare")
+    ("dfs", po::value<>(&par.dfs)->default_value(par.dfs), "Depth of association chains prefetched at once (zero or one means direct associations only)")
+    ("priority_queue", po::bool_switch(&par.is_priority_queue), "Keep the strongest associations by score instead of the latest ones")
+    ("key_granularity", po::value<>(&par.key_granularity)->default_value(par.key_granularity), "Requests are keyed by aligned blocks of this size in bytes, e.g. --block or --page (zero means byte addresses)")
+    ("overlap_block", po::value<>(&par.overlap_block_size)->default_value(par.overlap_block_size), "Requests inside or across predicted ranges get their associations, ranges are indexed by aligned blocks of this size in bytes (zero means exact starts only)")
+    ("eviction", po::value<PredictionEviction>(&par.prediction_eviction), "Predictions' eviction of a full prefetch table, default is Oldest\nPossible values: \n0) Oldest \n1) Clock (predictions w/o recent hits go first)")
+    ("streams", po::bool_switch(&streams), "DBSP predicts sequential/strided streams as LookAhead does and mines only the other requests")
+    ("stream_count", po::value<>(&par.stream_count)->default_value(par.stream_count), "Number of streams tracked by LookAhead (zero means the default one)")
+    ("stream_depth", po::value<>(&par.stream_depth)->default_value(par.stream_depth), "Max number of requests predicted ahead of a stream (zero means the default one)")
+    ("thread_count", po::value<>(&par.thread_count)->default_value(par.thread_count), "Number of predictor mining threads (zero means mining in the caller thread)")
+    ("partition_count", po::value<>(&par.partition_count)->default_value(par.partition_count), "Number of PartitionedDBSP partitions (zero means the default one)")
     ("queue", po::value<>(&max_queue_size)->default_value(0), "Max depth of tasks queue")
+    ("batch", po::value<>(&batch_size)->default_value(0), "Number of requests processed as a batch (zero means batching is off)")
+    ("prefetch_lead", po::value<>(&prefetch_lead)->default_value(0), "Predictions are prefetched this number of requests before their typical distance from the source (zero means prefetching at once)")
     ("predictor_auto_config", po::bool_switch(&pr_auto_config), "True, used auto configeration params with predictor_size_bytes ")
     ("predictor_size_bytes", po::value<>(&pr_metadata_size_bytes), " Max prefetcher metadata size, bytes")
     ("latency", po::bool_switch(&latency), "Build predictor latency histogram")
     ("preload_trace", po::bool_switch(&preload_trace), "Preload input trace file into memory")
-    ("sharded_predictor", po::bool_switch(&sharded_predictor), "Create predictor instance per shard");
+    ("sharded_predictor", po::bool_switch(&sharded_predictor), "Create predictor instance per shard")
+    ("snapshot", po::value<>(&par.snapshot_path), "Predictor's snapshot file: loaded at start if exists, saved at exit")
+    ("snapshot_records", po::bool_switch(&snapshot_records), "Save predictor's recorded requests to the snapshot too");
 
     // clang-format on
 
@@ -77,7 +97,10 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
-    if (sharded_predictor && num_shards) {
+    if (streams)
+        par.algo |= PredictorAlgoLookAhead;
+
+    if (!pr_auto_config && sharded_predictor && num_shards) {
         par.mining_table_num_rows /= num_shards;
         par.prefetch_table_num_rows /= num_shards;
         par.record_table_num_rows /= num_shards;
@@ -92,10 +115,18 @@ int main(int argc, char* argv[]) {
 
     std::cout << std::setw(30) << std::left << "Predictor type : " << (size_t)predictor_type << std::endl;
     std::cout << std::setw(30) << std::left << "Prediction strategy type : " << (size_t)prefetch_policy << std::endl;
+    std::cout << std::setw(30) << std::left << "Prefetch lead : " << prefetch_lead << std::endl;
 
     std::unique_ptr<ShardedCache> c;
     try {
-        c = std::make_unique<ShardedCache>(cache_type, prefetch_policy, predictor_type, num_shards, shard_size);
+        c = std::make_unique<ShardedCache>(cache_type, prefetch_policy, predictor_type, num_shards, shard_size, prefetch_lead);
+
+        //only the tables are sized, the other params are the given ones
+        if (pr_auto_config) {
+            par = c->get_predictor_params(par, pr_metadata_size_bytes, sharded_predictor);
+            if (!par.pf_list_size)
+                throw std::runtime_error("predictor doesn't fit " + std::to_string(pr_metadata_size_bytes) + " bytes");
+        }
 
         c->Init(cache_par, par, sharded_predictor);
 
@@ -113,11 +144,26 @@ int main(int argc, char* argv[]) {
         std::cout << std::setw(30) << std::left << "confidence : " << par.confidence << std::endl;
         std::cout << std::setw(30) << std::left << "pf_list_size : " << par.pf_list_size << std::endl;
         std::cout << std::setw(30) << std::left << "mining_table_num_rows : " << par.mining_table_num_rows << std::endl;
+        std::cout << std::setw(30) << std::left << "mining_step : " << par.mining_step << std::endl;
         std::cout << std::setw(30) << std::left << "req_size_update_policy : " << par.req_size_update_policy << std::endl;
         std::cout << std::setw(30) << std::left << "limit_size_for_size_policy : " << par.limit_size_for_size_policy << std::endl;
         std::cout << std::setw(30) << std::left << "prefetch_table_num_rows : " << par.prefetch_table_num_rows << std::endl;
         std::cout << std::setw(30) << std::left << "record_table_num_rows : " << par.record_table_num_rows << std::endl;
+        std::cout << std::setw(30) << std::left << "admission_count : " << par.admission_count << std::endl;
+        std::cout << std::setw(30) << std::left << "ts_type : " << par.ts_type << std::endl;
+        std::cout << std::setw(30) << std::left << "associations_metrics_type : " << par.associations_metrics_type << std::endl;
+        std::cout << std::setw(30) << std::left << "dfs : " << par.dfs << std::endl;
+        std::cout << std::setw(30) << std::left << "is_priority_queue : " << par.is_priority_queue << std::endl;
+        std::cout << std::setw(30) << std::left << "prediction_eviction : " << par.prediction_eviction << std::endl;
+        std::cout << std::setw(30) << std::left << "overlap_block_size : " << par.overlap_block_size << std::endl;
+        std::cout << std::setw(30) << std::left << "key_granularity : " << par.key_granularity << std::endl;
         std::cout << std::setw(30) << std::left << "thread_count : " << par.thread_count << std::endl;
+        if (par.algo & PredictorAlgoLookAhead || PredictorType::LookAhead == predictor_type) {
+            std::cout << std::setw(30) << std::left << "stream_count : " << par.stream_count << std::endl;
+            std::cout << std::setw(30) << std::left << "stream_depth : " << par.stream_depth << std::endl;
+        }
+        if (PredictorType::PartitionedDBSP == predictor_type)
+            std::cout << std::setw(30) << std::left << "partition_count : " << par.partition_count << std::endl;
     }
     Worker worker;
     worker.Start();
@@ -152,47 +198,38 @@ int main(int argc, char* argv[]) {
 
     auto start = std::chrono::steady_clock::now();
 
-    auto r = reader.read_next();
-    for (size_t i = 0; Valid(r); ++i, r = reader.read_next()) {
-        // r.alignToBlockSize(block_size);
-        auto futures = c->Process(r);
-        submitted += futures.size();
-
-        auto sync_future_func = [&, r, loop = i](auto&& future) -> void {
-            auto [hit, miss, p, e, l, num_req] = future.get();
+    auto sync_future_func = [&](auto&& future) -> void {
+        auto [hit, miss, p, e, l, num_req] = future.get();
 
-            hits += hit.val;
-            misses += miss.val;
-            total += hit.val + miss.val;
-            prefetched += p.val;
-            evicted_untouched += e.val;
-            num_internal_requests += num_req.val;
+        hits += hit.val;
+        misses += miss.val;
+        total += hit.val + miss.val;
+        prefetched += p.val;
+        evicted_untouched += e.val;
+        num_internal_requests += num_req.val;
 
-            {
+        {
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
-                std::unique_lock<std::mutex> lock(mutex);
+            std::unique_lock<std::mutex> lock(mutex);
 #endif
-                processed++;
-                if (latency) {
-                    if (l.val > 1000)
-                        l.val -= l.val % 1000;
-                    else if (l.val > 100)
-                        l.val -= l.val % 100;
-                    else if (l.val > 10)
-                        l.val -= l.val % 10;
-                    ++latency_stat[l.val];
-                }
+            processed++;
+            if (latency) {
+                if (l.val > 1000)
+                    l.val -= l.val % 1000;
+                else if (l.val > 100)
+                    l.val -= l.val % 100;
+                else if (l.val > 10)
+                    l.val -= l.val % 10;
+                ++latency_stat[l.val];
+            }
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
-                cv.notify_one();
+            cv.notify_one();
 #endif
-            }
+        }
+    };
 
-            // if (verbose > 1) {
-            //     printf("Request {%08zu:%08zu} => hit %d, miss %d\n", r.start_addr_, r.size_bytes_, hit.val, miss.val);
-            // } else if (verbose > 0 && !(processed.load() % 100)) {
-            //     printf("\r%.2f %%", loop / float(num_of_req) * 100);
-            // }
-        };
+    auto sync = [&](std::vector<std::future<Response>> futures) {
+        submitted += futures.size();
 
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
         for (auto& f : futures) {
@@ -212,11 +249,33 @@ int main(int argc, char* argv[]) {
             sync_future_func(std::move(f));
         }
 #endif
+    };
+
+    std::vector<Request> batch;
+    batch.reserve(batch_size);
+
+    auto r = reader.read_next();
+    for (; Valid(r); r = reader.read_next()) {
+        // r.alignToBlockSize(block_size);
+        if (batch_size) {
+            batch.push_back(r);
+            if (batch.size() == batch_size) {
+                sync(c->ProcessBatch(std::data(batch), std::size(batch)));
+                batch.clear();
+            }
+        } else
+            sync(c->Process(r));
     }
 
+    if (!batch.empty())
+        sync(c->ProcessBatch(std::data(batch), std::size(batch)));
+
     worker.Stop();
     auto stop = std::chrono::steady_clock::now();
 
+    if (!par.snapshot_path.empty() && c->SavePredictors(par.snapshot_path, snapshot_records))
+        std::cout << "WARNING: failed to save predictor's snapshot to " << par.snapshot_path << std::endl;
+
     std::cout << "\n\nResults:";
     std::cout.imbue(std::locale(std::locale(), new customseps));
     std::cout << "\nnum requests " << processed.load() + num_internal_requests.load() << ", hits " << hits.load() << ", misses " << misses.load() << ", total "
@@ -2,43 +2,82 @@
 
 #include <icache.h>
 
+#include <queue>
+#include <string>
 #include <vector>
 
 #include "worker.h"
 
+/* W/ 'prefetch_lead' N > 0 a prediction whose association is typically 'distance' requests (or time units w/ 'TimeStamp::DoubleTime')
+   after its source waits in the delay queue and is prefetched N of them before it's needed, so it doesn't evict
+   blocks long before it's read. Predictions of unknown or shorter distance are prefetched at once.
+   Distances are the predictor's time stamps (see 'IPredictor::get_time_stamp'), so each predictor has its own queue
+   whose clock is the predictor's stamp */
 class ShardedCache {
 public:
-    ShardedCache(CacheType t, PrefetchPolicy p, PredictorType pt, size_t num_shards, size_t shard_size)
+    ShardedCache(CacheType t, PrefetchPolicy p, PredictorType pt, size_t num_shards, size_t shard_size, size_t prefetch_lead = 0)
         : _type(t),
           _prefetch_policy(p),
           _predictor_type(pt),
           _num_shards(num_shards),
-          _shard_size(shard_size) {}
+          _shard_size(shard_size),
+          _prefetch_lead(prefetch_lead) {}
 
     void Init(const CacheParams&, const PredictorParams&, bool);
-    PredictorParams get_predictor_params(size_t);
+    // Params 'pp' w/ predictor's tables sized to fit 'size' bytes in total, the budget is split over shards' predictors if sharded
+    PredictorParams get_predictor_params(const PredictorParams& pp, size_t size, bool);
+    // Saves snapshots of the predictors, a predictor per shard saves to 'path.<shard index>'
+    int SavePredictors(const std::string& path, bool with_records);
     virtual ~ShardedCache() = default;
 
     std::vector<std::future<Response>> Process(const Request& r) {
+            Advance();
 
-            auto on_prediction = [&](const Request& r) -> void {
-                auto res = Prefetch(r);
-
-                std::lock_guard<std::mutex> lock(_mutex);
-                std::move(std::begin(res), std::end(res), std::back_inserter(_cached_response));
-            };
-
-            auto read = [this, on_prediction](const Request& r, uint8_t idx) -> Response {
-                return _caches[idx]->Read(r, on_prediction);
+            auto read = [this](const Request& r, uint8_t idx) -> Response {
+                return _caches[idx]->Read(r, [this, idx](const Request& r, const Request& source, size_t distance) {
+                    Schedule(idx, r, source, distance);
+                });
             };
             return DispatchToShard(r, read, false);
     }
 
+    // Same as 'Process' for 'count' requests, shard requests are grouped into a batch per shard
+    std::vector<std::future<Response>> ProcessBatch(const Request* reqs, size_t count);
+
 private:
     std::vector<std::future<Response>> DispatchToShard(const Request& r, std::function<Response(const Request&, uint8_t)> f, bool pushToFront);
-    std::vector<std::future<Response>> Prefetch(const Request& r) {
-        auto prefetch = [this](const Request& r, uint8_t idx) -> Response {
-            return _caches[idx]->Prefetch(r);
+
+    // Splits 'r' by shards invoking 'f(shard index, shard request)'
+    template <typename F>
+    void ForEachShard(const Request& r, F f) {
+        auto shard_idx = r.start_addr_ / _shard_size;
+        auto range = std::make_pair<size_t, size_t>(r.start_addr_ / _cache_par.block_size,
+                                                    r.start_addr_ / _cache_par.block_size + r.size_bytes_ / _cache_par.block_size);
+
+        while (range.first < range.second) {
+            const auto current_shard = std::make_pair<size_t, size_t>(shard_idx * _blocks_in_shard, (shard_idx + 1) * _blocks_in_shard);
+            const auto start_idx_inside_shard = range.first - current_shard.first;
+            const auto end_idx_inside_shard =
+                (current_shard.first < range.second) && (range.second < current_shard.second) ? (range.second - current_shard.first) : _blocks_in_shard;
+            const auto block_num_inside_shard = end_idx_inside_shard - start_idx_inside_shard;
+
+            f(shard_idx % _num_shards, Request{ range.first * _cache_par.block_size, block_num_inside_shard * _cache_par.block_size, r.time_, r.op_ });
+
+            range.first += block_num_inside_shard;
+            ++shard_idx;
+        }
+    }
+
+    // Returns responses of prefetches issued since the last call
+    void TakeCachedResponses(std::vector<std::future<Response>>&);
+    // Prefetches 'r' predicted by the predictor of shard 'idx' at once or queues it till its 'distance' less the lead has passed
+    void Schedule(size_t idx, const Request& r, const Request& source, size_t distance);
+    // Issues the prefetches which are due by the predictors' clocks
+    void Advance();
+    // 'source' is the request 'r' is associated with
+    std::vector<std::future<Response>> Prefetch(const Request& r, const Request& source) {
+        auto prefetch = [this, source](const Request& r, uint8_t idx) -> Response {
+            return _caches[idx]->Prefetch(r, source);
         };
         return DispatchToShard(r, prefetch, true);
     }
@@ -51,8 +90,25 @@ private:
     CacheParams _cache_par;
     uint32_t _blocks_in_shard;
     std::vector<std::unique_ptr<ICache>> _caches;
+    std::vector<std::shared_ptr<IPredictor>> _predictors;
     std::vector<std::unique_ptr<Worker>> _threads;
 
     std::mutex _mutex;
     std::vector<std::future<Response>> _cached_response;
+
+    struct Delayed {
+        size_t due;
+        Request request;
+        Request source;
+
+        bool operator<(const Delayed& d) const {
+            return due > d.due;  // the earliest is on top
+        }
+    };
+
+    size_t _prefetch_lead;
+    size_t _delayed_limit = 0;  // of all queues
+    size_t _delayed_size = 0;
+    std::mutex _delayed_mutex;
+    std::vector<std::priority_queue<Delayed>> _delayed;  // by '_predictors'
 };
@@ -66,6 +66,72 @@ std::istream& operator>>(std::istream& in, PredictorType& p) {
 
     if (token == "DBSP")
         p = PredictorType::DBSP;
+    else if (token == "PARTITIONEDDBSP")
+        p = PredictorType::PartitionedDBSP;
+    else if (token == "LOOKAHEAD")
+        p = PredictorType::LookAhead;
+    else if (token == "MITHRIL")
+        p = PredictorType::Mithril;
+    else
+        in.setstate(std::ios_base::failbit);
+
+    return in;
+}
+
+std::istream& operator>>(std::istream& in, Metrics& m) {
+    std::string token;
+    in >> token;
+
+    boost::to_upper(token);
+
+    if (token == "ORIGINALPAPER")
+        m = Metrics::OriginalPaper;
+    else if (token == "MODULE")
+        m = Metrics::Module;
+    else if (token == "NORMALIZEDMODUL")
+        m = Metrics::NormalizedModul;
+    else if (token == "MINMODUL")
+        m = Metrics::MinModul;
+    else if (token == "SQUARE")
+        m = Metrics::Square;
+    else if (token == "NORMALIZEDSQUARE")
+        m = Metrics::NormalizedSquare;
+    else if (token == "MINSQUARE")
+        m = Metrics::MinSquare;
+    else
+        in.setstate(std::ios_base::failbit);
+
+    return in;
+}
+
+std::istream& operator>>(std::istream& in, TimeStamp& t) {
+    std::string token;
+    in >> token;
+
+    boost::to_upper(token);
+
+    if (token == "COUNTER" || token == "DOUBLECOUNTER")
+        t = TimeStamp::DoubleCounter;
+    else if (token == "TIME" || token == "DOUBLETIME")
+        t = TimeStamp::DoubleTime;
+    else
+        in.setstate(std::ios_base::failbit);
+
+    return in;
+}
+
+std::istream& operator>>(std::istream& in, PredictionEviction& e) {
+    std::string token;
+    in >> token;
+
+    boost::to_upper(token);
+
+    if (token == "OLDEST")
+        e = PredictionEvictionOldest;
+    else if (token == "CLOCK")
+        e = PredictionEvictionClock;
+    else
+        in.setstate(std::ios_base::failbit);
 
     return in;
 }
@@ -114,7 +180,7 @@ public:
         trace.read_header(io::ignore_missing_column, "ts", "hname", "d_number", "op", "adress", "size", "r_time");
 
         std::shared_ptr<request_t> req;
-        size_t ts, d_number, address, size, r_time;
+        size_t ts, d_number, address, size, r_time = 0;
         std::string hname, op;
 
         if (num_skip){
@@ -131,7 +197,7 @@ public:
             if (op.compare(std::string("Read"))){
                 OperationType operation_type = OperationType::Read;
             }
-            r = Request{address, size, ts, operation_type};
+            r = Request{address, size, r_time, operation_type};
             _requests.emplace_back(std::move(r));
         }
         _trace_length = _requests.size();
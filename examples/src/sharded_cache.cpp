@@ -1,33 +1,53 @@
 #include "sharded_cache.h"
 
-PredictorParams ShardedCache::get_predictor_params(size_t predictor_size_in_bytes) {
-    PredictorParams pp = PredictorParams();
-    // std::shared_ptr<IPredictor> predictor = IPredictor::create(_predictor_type, pp);
-    // pp = predictor->get_params(predictor_size_in_bytes);
-    return pp;
+PredictorParams ShardedCache::get_predictor_params(const PredictorParams& pp, size_t predictor_size_in_bytes, bool bShardedPredictor) {
+    if (bShardedPredictor && _num_shards)
+        predictor_size_in_bytes /= _num_shards;
+
+    std::shared_ptr<IPredictor> predictor = IPredictor::create(_predictor_type, pp);
+    return predictor ? predictor->get_params(predictor_size_in_bytes) : pp;
+}
+
+int ShardedCache::SavePredictors(const std::string& path, bool with_records) {
+    for (size_t i = 0; i < _predictors.size(); ++i) {
+        if (auto r = _predictors[i]->save(_predictors.size() > 1 ? path + "." + std::to_string(i) : path, with_records))
+            return r;
+    }
+
+    return 0;
 }
 
 void ShardedCache::Init(const CacheParams& par, const PredictorParams& pp, bool bShardedPredictor) {
     _cache_par = par;
     _blocks_in_shard = _shard_size / _cache_par.block_size;
+    // pending prefetches beyond the blocks of the cache would evict each other anyway
+    _delayed_limit = _cache_par.cache_size / _cache_par.block_size;
 
     CacheParams new_par = _cache_par;
     new_par.cache_size = _num_shards ? _cache_par.cache_size / _num_shards : _cache_par.cache_size;
 
     std::vector<std::shared_ptr<IPredictorLink>> predictors(_num_shards ? _num_shards : 1);
     if (bShardedPredictor) {
-        for (auto& predictorlink : predictors) {
-            std::shared_ptr<IPredictor> predictor = IPredictor::create(_predictor_type, pp);
-            predictor->init(pp);
-            predictorlink = std::move(_prefetch_policy != PrefetchPolicy::Never ? predictor->registerLink() : nullptr);
+        for (size_t i = 0; i < predictors.size(); ++i) {
+            auto p = pp;
+            if (!p.snapshot_path.empty() && predictors.size() > 1)
+                p.snapshot_path += "." + std::to_string(i);
+
+            std::shared_ptr<IPredictor> predictor = IPredictor::create(_predictor_type, p);
+            predictor->init(p);
+            predictors[i] = std::move(_prefetch_policy != PrefetchPolicy::Never ? predictor->registerLink() : nullptr);
+            _predictors.emplace_back(std::move(predictor));
         }
     } else {
         std::shared_ptr<IPredictor> predictor = IPredictor::create(_predictor_type, pp);
         predictor->init(pp);
         auto p = std::move(_prefetch_policy != PrefetchPolicy::Never ? predictor->registerLink() : nullptr);
         std::fill(predictors.begin(), predictors.end(), p);
+        _predictors.emplace_back(std::move(predictor));
     }
 
+    _delayed.resize(_predictors.size());
+
     if (_num_shards) {
         for (size_t i = 0; i < _num_shards; ++i) {
             auto c = CreateCache(_type, _prefetch_policy);
@@ -55,33 +75,114 @@ std::vector<std::future<Response>> ShardedCache::DispatchToShard(const Request&
         res.emplace_back(task.get_future());
         task();
     } else {
-        auto shard_idx = r.start_addr_ / _shard_size;
-        auto range = std::make_pair<size_t, size_t>(r.start_addr_ / _cache_par.block_size,
-                                                    r.start_addr_ / _cache_par.block_size + r.size_bytes_ / _cache_par.block_size);
-
-        while (range.first < range.second) {
-            const auto current_shard = std::make_pair<size_t, size_t>(shard_idx * _blocks_in_shard, (shard_idx + 1) * _blocks_in_shard);
-            const auto start_idx_inside_shard = range.first - current_shard.first;
-            const auto end_idx_inside_shard =
-                (current_shard.first < range.second) && (range.second < current_shard.second) ? (range.second - current_shard.first) : _blocks_in_shard;
-            const auto block_num_inside_shard = end_idx_inside_shard - start_idx_inside_shard;
-
-            const auto idx = shard_idx % _num_shards;
+        ForEachShard(r, [&](size_t idx, const Request& shard_request) {
             auto f = [action, idx](const Request& r) -> Response {
                 return action(r, idx);
             };
-
-            const auto shard_request = Request{ range.first * _cache_par.block_size, block_num_inside_shard * _cache_par.block_size};
             res.emplace_back(_threads[idx]->AddTask(pushtoFront, f, shard_request));
+        });
+    }
 
-            range.first += block_num_inside_shard;
-            ++shard_idx;
-        }
+    TakeCachedResponses(res);
+    return res;
+}
+
+std::vector<std::future<Response>> ShardedCache::ProcessBatch(const Request* reqs, size_t count) {
+    Advance();
+
+    // shard requests and promises of their responses grouped by shards
+    struct Batch {
+        std::vector<Request> requests;
+        std::vector<std::promise<Response>> responses;
+    };
+    std::vector<std::shared_ptr<Batch>> batches(_num_shards ? _num_shards : 1);
+    std::vector<std::future<Response>> res;
+
+    auto add = [&](size_t idx, const Request& r) {
+        auto& b = batches[idx];
+        if (!b)
+            b = std::make_shared<Batch>();
+        b->requests.push_back(r);
+        b->responses.emplace_back();
+        res.emplace_back(b->responses.back().get_future());
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        if (0 == _num_shards)
+            add(0, reqs[i]);
+        else
+            ForEachShard(reqs[i], add);
     }
 
+    for (size_t idx = 0; idx < batches.size(); ++idx) {
+        if (!batches[idx])
+            continue;
+
+        auto read = [this, idx, b = batches[idx]]() {
+            std::vector<Response> out(b->requests.size());
+            _caches[idx]->ReadBatch(std::data(b->requests), std::size(b->requests), std::data(out),
+                                    [this, idx](const Request& r, const Request& source, size_t distance) {
+                                        Schedule(idx, r, source, distance);
+                                    });
+            for (size_t i = 0; i < out.size(); ++i)
+                b->responses[i].set_value(out[i]);
+        };
+
+        if (0 == _num_shards)
+            read();
+        else
+            std::ignore = _threads[idx]->AddTask(false, read);
+    }
+
+    TakeCachedResponses(res);
+    return res;
+}
+
+void ShardedCache::TakeCachedResponses(std::vector<std::future<Response>>& res) {
     std::lock_guard<std::mutex> lock(_mutex);
     std::move(std::begin(_cached_response), std::end(_cached_response), std::back_inserter(res));
     _cached_response.clear();
+}
 
-    return res;
+void ShardedCache::Schedule(size_t idx, const Request& r, const Request& source, size_t distance) {
+    if (_prefetch_lead && distance > _prefetch_lead) {
+        // a predictor shared by shards is the only one
+        auto p = _predictors.size() > 1 ? idx : 0;
+        auto now = _predictors[p]->get_time_stamp();
+
+        std::lock_guard<std::mutex> lock(_delayed_mutex);
+        if (_delayed_size < _delayed_limit) {
+            _delayed[p].push(Delayed{ now + distance - _prefetch_lead, r, source });
+            ++_delayed_size;
+            return;
+        }
+    }
+
+    auto res = Prefetch(r, source);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::move(std::begin(res), std::end(res), std::back_inserter(_cached_response));
+}
+
+void ShardedCache::Advance() {
+    if (!_prefetch_lead)
+        return;
+
+    std::vector<Delayed> due;
+    {
+        std::lock_guard<std::mutex> lock(_delayed_mutex);
+        for (size_t i = 0; i < _delayed.size(); ++i) {
+            auto& d = _delayed[i];
+            for (auto now = _predictors[i]->get_time_stamp(); !d.empty() && d.top().due <= now; d.pop())
+                due.push_back(d.top());
+        }
+        _delayed_size -= due.size();
+    }
+
+    for (auto& d : due) {
+        auto res = Prefetch(d.request, d.source);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::move(std::begin(res), std::end(res), std::back_inserter(_cached_response));
+    }
 }
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <chrono>
 #include <stdexcept>
+#include <vector>
 
 template <typename T>
 class Cache : public ICache {
@@ -18,8 +19,17 @@ public:
 
         if (_predictor.get() == nullptr)
             _prefetch_policy = PrefetchPolicy::Never;
+        else {
+            auto limit = _predictor->getAssociationsLimit();
+            _associations_limit = limit ? limit : default_associations_limit;
+            _associations.resize(_associations_limit);
+            _distances.resize(_associations_limit);
+        }
 
-        return _impl.Init(par);
+        return _impl.Init(par, [this](const Request& source, const Request& block, bool useful) {
+            if (_predictor && Valid(source))
+                useful ? _predictor->reportUseful(source, block) : _predictor->reportWasted(source, block);
+        });
     }
 
     virtual ~Cache() = default;
@@ -28,20 +38,19 @@ public:
         return _impl.Write(r);
     }
 
-    virtual Response Read(const Request& r, std::function<void(const Request&)> action_on_prediction) {
+    virtual Response Read(const Request& r, std::function<void(const Request&, const Request&, size_t)> action_on_prediction) {
         auto hit_count = _impl.Read(r);
 
         auto start = std::chrono::system_clock::now();
         if (PrefetchPolicy::Never != _prefetch_policy) {
-            if (_predictor->compute(r, (size_t)0))
+            if (_predictor->compute(r, r.time_))
                 throw std::runtime_error("predictor->compute failed\n");
         }
 
         if (PrefetchPolicy::Always == _prefetch_policy || (PrefetchPolicy::OnMiss == _prefetch_policy && std::get<cache::Misses>(hit_count).val != 0)) {
-            auto prediction = _predictor->getAssociatedVectorOfRequests(r);
-            std::for_each(std::begin(prediction), std::end(prediction), [&action_on_prediction](auto r) {
-                action_on_prediction(r);
-            });
+            auto n = _predictor->getAssociatedRequests(r, std::data(_associations), _associations_limit, 0, std::data(_distances));
+            for (size_t i = 0; i < n; ++i)
+                action_on_prediction(_associations[i], r, _distances[i]);
         }
 
         auto diff = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now() - start).count();
@@ -50,11 +59,49 @@ public:
         return hit_count;
     }
 
-    virtual Response Prefetch(const Request& r) {
-        return _impl.Prefetch(r);
+    /* Feeds the predictor and queries it once per batch, latency of the predictor is shared by the batch requests.
+       Associations of a request are handed to 'action_on_prediction' right after its read, so they are in time for the next ones */
+    virtual void ReadBatch(const Request* reqs, size_t count, Response* out, std::function<void(const Request&, const Request&, size_t)> action_on_prediction) {
+        auto start = std::chrono::system_clock::now();
+        if (PrefetchPolicy::Never != _prefetch_policy) {
+            if (_predictor->computeBatch(reqs, count))
+                throw std::runtime_error("predictor->computeBatch failed\n");
+
+            _counts.resize(count);
+            _associations.resize(std::max(_associations.size(), count * _associations_limit));
+            _distances.resize(std::size(_associations));
+            _predictor->getAssociationsBatch(reqs, count, std::data(_associations), std::size(_associations), std::data(_counts), std::data(_distances));
+        }
+        auto diff = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now() - start).count();
+
+        size_t associations = 0;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = _impl.Read(reqs[i]);
+            std::get<cache::Latency>(out[i]).val = diff / count;
+
+            if (PrefetchPolicy::Never == _prefetch_policy)
+                continue;
+
+            if (PrefetchPolicy::Always == _prefetch_policy || (PrefetchPolicy::OnMiss == _prefetch_policy && std::get<cache::Misses>(out[i]).val != 0))
+                for (size_t j = associations; j < associations + _counts[i]; ++j)
+                    action_on_prediction(_associations[j], reqs[i], _distances[j]);
+            associations += _counts[i];
+        }
+    }
+
+    virtual Response Prefetch(const Request& r, const Request& source) {
+        return _impl.Prefetch(r, source);
     }
 
 private:
+    //Room for associations per request if the predictor doesn't limit them
+    static constexpr size_t default_associations_limit = 16;
+
+    size_t _associations_limit = 0;
+    std::vector<Request> _associations;  //associations of the request(s) being read
+    std::vector<size_t> _distances;      //of '_associations'
+    std::vector<size_t> _counts;
+
     T _impl;
     std::shared_ptr<IPredictorLink> _predictor;
     PrefetchPolicy _prefetch_policy;
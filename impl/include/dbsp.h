@@ -4,11 +4,18 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <limits>
 #include <map>
+#include <string>
 #include <vector>
 
 #include "config.h"
+#include "lookahead.h"
+#include "rcu.h"
+#include "simd.h"
+#include "utils.h"
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
 #    include <condition_variable>
 #    include <mutex>
@@ -22,7 +29,8 @@
 template <typename T>
 struct Entry : Request {
     using TimeStamp = T;
-    std::vector<TimeStamp> mutable times;
+    //bound to a row of the table's slab, so holds up to 'max_support + 1' stamps
+    SlabRow<TimeStamp> mutable times;
 
     Entry() = default;
     Entry(Request const& r) : Request(r) {}
@@ -38,19 +46,75 @@ struct Entry : Request {
         auto count = std::min(times.size(), r.times.size());
         assert(count);
 
-        auto a = std::make_tuple(std::numeric_limits<T>::max(), std::numeric_limits<T>::min());
-        for (size_t i = 1, error = 0; i < count; ++i) {
-            auto delta = std::abs(times[i] - r.times[i]);
-            if (delta > lookahead)
-                ++error;
+        //w/ a single stamp the distance is of the first ones (which are within 'lookahead' in the mining window)
+        if (count == 1) {
+            auto delta = size_t(std::abs(times[0] - r.times[0]));
+            return std::make_tuple(delta, delta);
+        }
 
-            if (error > confidence)
+        if constexpr (std::is_same_v<T, int64_t>) {
+            auto limit = int64_t(std::min<size_t>(lookahead, std::numeric_limits<int64_t>::max()));
+            auto d = simd::Distance(&times[1], &r.times[1], count - 1, limit);
+            if (d.errors > confidence)
                 return std::nullopt;
 
-            a = std::make_tuple(std::min(std::get<0>(a), delta), std::max(std::get<1>(a), delta));
+            return std::make_tuple(d.min, d.max);
+        } else {
+            auto a = std::make_tuple(std::numeric_limits<T>::max(), std::numeric_limits<T>::min());
+            for (size_t i = 1, error = 0; i < count; ++i) {
+                auto delta = std::abs(times[i] - r.times[i]);
+                if (delta > lookahead)
+                    ++error;
+
+                if (error > confidence)
+                    return std::nullopt;
+
+                a = std::make_tuple(std::min(std::get<0>(a), delta), std::max(std::get<1>(a), delta));
+            }
+
+            return a;
         }
+    }
 
-        return a;
+    /* Score of the association w/ 'r' by metric 'm' of stamps' distances (higher is stronger): 1 / (1 + metric).
+       'OriginalPaper' ranks by the min distance like 'MinModul' */
+    double Score(Entry const& r, Metrics m) const {
+        auto count = std::min(times.size(), r.times.size());
+        assert(count);
+
+        double sum = 0, square = 0, min = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < count; ++i) {
+            auto delta = double(std::abs(times[i] - r.times[i]));
+            sum += delta;
+            square += delta * delta;
+            min = std::min(min, delta);
+        }
+
+        double metric;
+        switch (m) {
+        case Metrics::Module:
+            metric = sum;
+            break;
+        case Metrics::NormalizedModul:
+            metric = sum / count;
+            break;
+        case Metrics::Square:
+            metric = square;
+            break;
+        case Metrics::NormalizedSquare:
+            metric = square / count;
+            break;
+        case Metrics::MinSquare:
+            metric = min * min;
+            break;
+        case Metrics::OriginalPaper:
+        case Metrics::MinModul:
+        default:
+            metric = min;
+            break;
+        }
+
+        return 1 / (1 + metric);
     }
 
     TimeStamp Stamp(size_t index) const {
@@ -65,16 +129,21 @@ struct Entry : Request {
         return !times.empty();
     }
 
-    void Reset() {
+    void Reset() const {
         times.clear();
     }
 };
 
 class DBSP : public IPredictor, public IPredictorLink, public std::enable_shared_from_this<IPredictorLink> {
 public:
-    DBSP(const PredictorParams&);
+    //'partitioned' splits recorded requests into 'partition_count' partitions, so producers of different ones don't contend
+    DBSP(const PredictorParams&, bool partitioned = false);
     int init(const PredictorParams&);
-    PredictorParams get_params(size_t);
+    int save(std::string const&, bool) override;
+    PredictorParams get_params(size_t) override;
+    uint64_t get_time_stamp() const override;
+    //Bytes allocated by a predictor initialized w/ params
+    static size_t Footprint(PredictorParams const&);
     virtual ~DBSP();
 
 private:
@@ -83,39 +152,87 @@ private:
 
     int compute(Request, size_t) override;
     std::optional<Request> getAssociatedRequest(Request, double /*association_priority*/) override;
-    std::vector<Request> getAssociatedVectorOfRequests(Request, double /*association_priority*/) ;
+    std::vector<Request> getAssociatedVectorOfRequests(Request, double /*association_priority*/) override;
+    size_t getAssociatedRequests(Request, Request*, size_t, double /*association_priority*/, size_t*) override;
+    size_t getAssociationsLimit() const override;
+    int computeBatch(Request const*, size_t, size_t) override;
+    size_t getAssociationsBatch(Request const*, size_t, Request*, size_t, size_t*, size_t*) override;
+    size_t drainNotifications(void* /*owner*/, size_t) override;
+    void reportUseful(Request, Request) override;
+    void reportWasted(Request, Request) override;
 
     bool CheckAvailable() const;
 
 private:
     PredictorParams predicor_params;
 
-    /** timestamp, currently reference number **/
+    /** timestamp, reference number or the last time for 'TimeStamp::DoubleTime' **/
     std::atomic<uint64_t> ts;
+    std::chrono::steady_clock::time_point origin;  //of time stamps if neither caller nor request provides time
 
     struct RecordTable;
     struct PrefetchTable;
+    struct MiningWindow;
+    struct Subscriber;
+    struct Partition;
+    struct Clock;
     using Record = Entry<int64_t>;
 
-    std::unique_ptr<RecordTable> requests[2];
-    RecordTable* r_requests;  //recording requests
-    RecordTable* m_requests;  //mining requests
+    bool partitioned;
+    std::vector<std::unique_ptr<Partition>> partitions;  //recorded requests by address
+    std::atomic<size_t> recorded;                        //requests moved to mining tables since the last mining round
+    std::atomic<bool> filled;                            //a mining table is full
+    std::atomic<size_t> last_key{ SIZE_MAX };            //of the last request w/ 'key_granularity'
 
-    std::unique_ptr<PrefetchTable> q_predictions;  //querying predictions
+    LeftRight<PrefetchTable> q_predictions;        //querying predictions, readers don't lock
+    std::unique_ptr<Clock> clock;                  //eviction of querying predictions, shared by both instances
     std::unique_ptr<PrefetchTable> m_predictions;  //predictions under mining
-
-    void record(Request);
+    std::vector<std::unique_ptr<PrefetchTable>> w_predictions;  //predictions of additional mining workers
+    std::unique_ptr<MiningWindow> window;                       //requests under mining sorted by time
+
+    //cache's feedback on a prefetched block of an association of 'source'
+    struct Feedback {
+        size_t source;
+        size_t block;
+        bool useful;
+    };
+    std::vector<Feedback> feedback;  //reported since the last publication (up to its capacity)
+    std::vector<Feedback> applied;   //being applied by 'publish'
+
+    Partition& PartitionOf(Request const&) const;
+    Partition& StreamsOf(Request const&) const;
+    Request normalize(Request) const;
+    uint64_t Stamp(Request const&, size_t);
+    size_t collect(PrefetchTable const&, Request const&, Request*, size_t*, size_t) const;
+    void record(Request const*, size_t, size_t);
+    void report(Request const&, Request const&, bool);
+    bool streamed(Request const&);
     void do_mining();
+    void work(size_t, size_t);
+    void worker(size_t);
     void notify();
+    void publish();
     void mine();
+    void load(std::string const&);
 
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
     std::thread thread;
-    std::mutex c_mutex;         //compute guard
     std::mutex n_mutex;         //callback guard
-    std::shared_mutex m_mutex;  //mining guard
+    std::mutex f_mutex;         //feedback guard
+    std::shared_mutex m_mutex;  //mining tables' swap guard (exclusive while mining in caller's thread)
     std::condition_variable_any available;
+    std::condition_variable_any swapped;  //mining round has taken the mining tables
+    size_t swaps = 0;                     //under exclusive 'm_mutex'
+
+    std::vector<std::thread> workers;  //additional mining workers, one per 'w_predictions'
+    std::mutex w_mutex;                //mining rounds' guard
+    std::condition_variable w_round;   //a round is started or workers exit
+    std::condition_variable w_done;    //all workers have mined their ranges
+    size_t w_rounds = 0;               //started rounds
+    size_t w_mined = 0;                //rows mined by the last round
+    size_t w_pending = 0;              //workers still mining the last round
+    bool w_exit = false;
 #endif
 
-    std::map<void*, std::function<PredictorNotify>> callbacks;
+    std::map<void*, std::shared_ptr<Subscriber>> subscribers;  //shared w/ draining threads
 };
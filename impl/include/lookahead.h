@@ -0,0 +1,89 @@
+#pragma once
+
+#include <ipredictor.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "config.h"
+#include "utils.h"
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+#    include <mutex>
+#endif
+
+/* Detector of sequential and strided streams: a request at the same distance (stride) from the last one of a stream
+   as the last one from its predecessor confirms the stream, requests of a confirmed stream are predicted ahead of it.
+   Up to 'stream_count' streams are tracked (the least recently used one is replaced), a stream's prefetch depth
+   doubles w/ each confirmed request up to 'stream_depth' and halves w/ each prefetched block reported as wasted.
+   'Update' and 'Wasted' shall be serialized by the caller, while 'Predict' may run concurrently w/ them:
+   it reads confirmed streams published by the writer under a sequence lock w/o locking */
+class StreamDetector {
+public:
+    StreamDetector(PredictorParams const&);
+
+    static size_t Footprint(PredictorParams const&);
+
+    //Returns true if 'r' continues a confirmed stream
+    bool Update(Request const& r);
+
+    //Requests ahead of confirmed stream whose last request is 'r', returns the number written to 'out'
+    size_t Predict(Request const& r, Request* out, size_t capacity) const;
+
+    //Block 'assoc' prefetched ahead of 'src' is evicted w/o reads
+    void Wasted(Request const& src, Request const& assoc);
+
+    //Max num of requests predicted at once
+    size_t Depth() const {
+        return max_depth;
+    }
+
+private:
+    struct Stream {
+        size_t last = 0;     //start of the last request
+        size_t size = 0;     //size of the last request
+        int64_t stride = 0;  //zero means unknown yet
+        uint32_t hits = 0;   //requests at the stride in a row
+        uint32_t depth = 0;  //num of requests predicted ahead
+        uint64_t used = 0;   //LRU stamp
+    };
+
+    //Stream as it's seen by 'Predict', 'seq' is odd while the writer updates it
+    struct Published {
+        std::atomic<uint32_t> seq{ 0 };
+        std::atomic<size_t> last{ 0 };
+        std::atomic<size_t> size{ 0 };
+        std::atomic<int64_t> stride{ 0 };
+        std::atomic<uint32_t> depth{ 0 };  //zero for unconfirmed streams
+    };
+
+    static constexpr uint32_t min_hits = 2;
+    //a request farther than that (in sizes of requests) from a stream doesn't train it
+    static constexpr int64_t max_stride = 64;
+
+    std::vector<Stream> streams;
+    std::unique_ptr<Published[]> published;  //of 'streams'
+    size_t max_depth;
+    uint64_t tick = 0;
+
+    Stream* Victim();
+    void Publish(Stream const&);
+};
+
+/* 'PredictorType::LookAhead': stream detector per link w/o mining, so every link (e.g. shard) tracks its own streams.
+   'registerLink(owner, notify)' invokes 'notify' from 'compute' once there are predictions */
+class LookAhead : public IPredictor {
+public:
+    LookAhead(const PredictorParams&);
+    int init(const PredictorParams&) override;
+    PredictorParams get_params(size_t) override;
+
+private:
+    struct Link;
+
+    std::shared_ptr<IPredictorLink> registerLink() override;
+    std::shared_ptr<IPredictorLink> registerLink(void* /*owner*/, std::function<PredictorNotify>) override;
+
+    PredictorParams predicor_params;
+};
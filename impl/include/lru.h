@@ -2,6 +2,7 @@
 
 #include <icache.h>
 
+#include <functional>
 #include <list>
 #include <memory>
 #include <stdexcept>
@@ -175,13 +176,16 @@ private:
 
 class LruCache {
 public:
-    void Init(const CacheParams&);
+    // Gets source of a prefetched block, the block and whether it's read (useful) or evicted w/o reads (wasted)
+    using Feedback = std::function<void(const Request& /*source*/, const Request& /*block*/, bool /*useful*/)>;
+
+    void Init(const CacheParams&, Feedback = nullptr);
     ~LruCache() = default;
 
     Response Write(const Request&);
     Response Read(const Request&);
 
-    Response Prefetch(const Request&);
+    Response Prefetch(const Request&, const Request& source = {});
 
 private:
     void Verify(const Request&) const;
@@ -194,8 +198,22 @@ private:
         uint32_t val;
     };
 
-    using page_w_blocks_t = std::unordered_map<uint32_t /*blk index*/, std::tuple<IsFromPredictor, NumReads>>;
+    // Request a prefetched block is associated with
+    struct Source {
+        size_t start_addr;
+        size_t size_bytes;
+    };
+
+    using block_t = std::tuple<IsFromPredictor, NumReads, Source>;
+    using page_w_blocks_t = std::unordered_map<uint32_t /*blk index*/, block_t>;
+
+    // Counts prefetched blocks of evicted page 'id' w/o reads reporting them as wasted
+    uint32_t Evicted(size_t id, const page_w_blocks_t&) const;
+    // Counts a read of the block reporting the first one of a prefetched block as useful
+    void Touched(size_t id, uint32_t blk, block_t&) const;
+
     std::unique_ptr<lru_cache<size_t, page_w_blocks_t>> _cache;
     CacheParams _par;
     uint32_t _blocks_in_page;
+    Feedback _feedback;
 };
\ No newline at end of file
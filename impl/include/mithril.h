@@ -0,0 +1,83 @@
+#pragma once
+
+#include <ipredictor.h>
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+#include "utils.h"
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+#    include <mutex>
+#endif
+
+/* Mithril (Yang J. et al.) as it's described in the paper, the baseline to compare DBSP with:
+   - record table is a ring of requests w/ their time stamps (reference numbers), a request is moved to
+     the mining table at 'min_support' stamps and dropped as too frequent beyond 'max_support' ones;
+   - full mining table is mined at once in the caller's thread: requests sorted by the first stamp are associated
+     w/ the following ones whose stamps are within 'lookahead_range' (up to 'confidence' mismatches);
+   - prefetch table is a ring of requests w/ up to 'pf_list_size' associations, the oldest ones are replaced.
+   Tables are plain arrays indexed by 'std::unordered_map' and guarded by a single lock */
+class Mithril : public IPredictor, public IPredictorLink, public std::enable_shared_from_this<IPredictorLink> {
+public:
+    Mithril(const PredictorParams&);
+    int init(const PredictorParams&) override;
+    PredictorParams get_params(size_t) override;
+    //Bytes allocated by a predictor initialized w/ params
+    static size_t Footprint(PredictorParams const&);
+
+private:
+    std::shared_ptr<IPredictorLink> registerLink() override;
+    std::shared_ptr<IPredictorLink> registerLink(void* /*owner*/, std::function<PredictorNotify>) override;
+
+    int compute(Request, size_t) override;
+    std::optional<Request> getAssociatedRequest(Request, double /*association_priority*/) override;
+    std::vector<Request> getAssociatedVectorOfRequests(Request, double /*association_priority*/) override;
+    size_t getAssociatedRequests(Request, Request*, size_t, double /*association_priority*/, size_t*) override;
+    size_t getAssociationsLimit() const override;
+
+private:
+    //Request of a table, its stamps (record and mining tables) or associations (prefetch table) are in the table's slab
+    struct Row {
+        size_t start_addr;
+        size_t size_bytes;
+        uint32_t count;  //zero means free row
+    };
+
+    static constexpr uint32_t mining = 1u << 31;  //flag of 'records' values referring to the mining table
+
+    PredictorParams predicor_params;
+    int64_t ts = 0;
+    size_t max_stamps = 0;        //slab's row of a record
+    size_t max_associations = 0;  //slab's row of a prediction
+
+    std::vector<Row> r_rows;  //record table
+    std::vector<int64_t> r_stamps;
+    size_t r_next = 0;  //the oldest row of the ring
+
+    std::vector<Row> m_rows;  //mining table, 'm_size' rows are used
+    std::vector<int64_t> m_stamps;
+    size_t m_size = 0;
+    std::vector<uint32_t> m_order;  //mining rows sorted by the first stamp
+
+    std::unordered_map<size_t, uint32_t> records;  //start of a request => row of the record or the mining table
+
+    std::vector<Row> p_rows;  //prefetch table
+    std::vector<Request> p_associations;
+    std::vector<uint32_t> p_oldest;  //association replaced next
+    size_t p_next = 0;               //the oldest row of the ring
+    std::unordered_map<size_t, uint32_t> predictions;
+
+    std::map<void*, std::function<PredictorNotify>> subscribers;
+
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    std::mutex mutex;
+#endif
+
+    void record(Request const&);
+    void drop(uint32_t);
+    void mine();
+    bool associated(uint32_t, uint32_t) const;
+    uint32_t associate(Row const&, Row const&);
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+/* Readers' counter spread over cache line sized slots, a thread always arrives/departs at the same slot,
+   so readers of different threads don't bounce the same cache line */
+class ReadIndicator {
+public:
+    size_t Arrive() {
+        auto i = Slot();
+        counters[i].value.fetch_add(1, std::memory_order_seq_cst);
+        return i;
+    }
+
+    void Depart(size_t i) {
+        counters[i].value.fetch_sub(1, std::memory_order_release);
+    }
+
+    bool Empty() const {
+        for (auto& c : counters)
+            if (c.value.load(std::memory_order_acquire))
+                return false;
+
+        return true;
+    }
+
+private:
+    static constexpr size_t slots = 64;
+
+    struct alignas(64) Counter {
+        std::atomic<int64_t> value{ 0 };
+    };
+    std::array<Counter, slots> counters;
+
+    static size_t Slot() {
+        static std::atomic<size_t> threads{ 0 };
+        thread_local size_t slot = threads.fetch_add(1, std::memory_order_relaxed) % slots;
+        return slot;
+    }
+};
+
+/* Left-Right publication of two instances of 'T' (Ramalhete, Correia):
+   - readers are wait-free and see the published instance unchanged during the read;
+   - the writer modifies the standby instance, publishes it, waits for readers of the previous one
+     to depart (grace period) and replays the same modification on it.
+   So the modification shall be deterministic. Writers shall be serialized by the caller. */
+template <typename T>
+class LeftRight {
+public:
+    void Reset(std::unique_ptr<T> l, std::unique_ptr<T> r) {
+        instances[0] = std::move(l);
+        instances[1] = std::move(r);
+        published.store(0, std::memory_order_seq_cst);
+    }
+
+    template <typename F>
+    decltype(auto) Read(F f) const {
+        struct Guard {
+            ReadIndicator& indicator;
+            size_t slot;
+            ~Guard() {
+                indicator.Depart(slot);
+            }
+        };
+
+        auto& indicator = indicators[version.load(std::memory_order_seq_cst)];
+        Guard guard{ indicator, indicator.Arrive() };
+        return f(static_cast<T const&>(*instances[published.load(std::memory_order_seq_cst)]));
+    }
+
+    template <typename F>
+    void Write(F f) {
+        auto p = published.load(std::memory_order_relaxed);
+        f(*instances[1 - p]);
+        published.store(1 - p, std::memory_order_seq_cst);
+
+        //grace period: readers which might still see the previous instance shall depart
+        auto v = version.load(std::memory_order_relaxed);
+        Wait(indicators[1 - v]);
+        version.store(1 - v, std::memory_order_seq_cst);
+        Wait(indicators[v]);
+
+        f(*instances[p]);
+    }
+
+private:
+    std::unique_ptr<T> instances[2];
+    std::atomic<size_t> published{ 0 };
+    std::atomic<size_t> version{ 0 };
+    mutable ReadIndicator indicators[2];
+
+    static void Wait(ReadIndicator const& indicator) {
+        while (!indicator.Empty())
+            std::this_thread::yield();
+    }
+};
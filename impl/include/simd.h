@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simd {
+
+struct Deltas {
+    int64_t min;
+    int64_t max;
+    size_t errors;  //num of deltas exceeding lookahead
+};
+
+/* Min/max of deltas |a[i] - b[i]|, i in [0, count) and num of them exceeding 'lookahead'.
+   Min/max are 'numeric_limits<int64_t>::max/min' for empty sequences.
+   Vectorized version (AVX2 or SSE4.2) is selected at runtime, results are the same as of the scalar one */
+Deltas Distance(int64_t const* a, int64_t const* b, size_t count, int64_t lookahead);
+
+//Name of the selected implementation
+char const* Name();
+
+}  // namespace simd
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* On-disk snapshot of predictor's tables:
+     Header | Prediction entries | Record entries
+   Entries of a section have the same size given in the header, so a section is walked as an array w/o parsing.
+   Multi-byte values are in the host byte order */
+namespace snapshot {
+
+constexpr char magic[8] = { 'D', 'B', 'S', 'P', 'S', 'N', 'A', 'P' };
+constexpr uint32_t version = 2;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t ts;       //predictor's time stamp
+    uint32_t ts_type;  //'TimeStamp' of the stamps
+    uint32_t pf_list_size;
+    uint32_t prediction_size;  //bytes per prediction entry
+    uint32_t max_stamps;
+    uint32_t record_size;  //bytes per record entry
+    uint32_t reserved;
+    uint64_t predictions;  //num of prediction entries
+    uint64_t records;      //num of record entries
+};
+
+struct Association {
+    uint64_t start_addr;
+    uint64_t size_bytes;
+    uint64_t distance;  //min distance of stamps to the source's ones, zero if unknown
+    double value;
+};
+
+//Followed by 'pf_list_size' associations, 'count' of them are valid
+struct Prediction {
+    uint64_t start_addr;
+    uint64_t size_bytes;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+//Followed by 'max_stamps' stamps, 'count' of them are valid
+struct Record {
+    uint64_t start_addr;
+    uint64_t size_bytes;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+constexpr size_t PredictionSize(size_t pf_list_size) {
+    return sizeof(Prediction) + pf_list_size * sizeof(Association);
+}
+
+constexpr size_t RecordSize(size_t max_stamps) {
+    return sizeof(Record) + max_stamps * sizeof(int64_t);
+}
+
+//Read only mapping of a whole file, empty if the file can't be mapped
+class MappedFile {
+public:
+    explicit MappedFile(std::string const& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    uint8_t const* Data() const {
+        return static_cast<uint8_t const*>(data);
+    }
+
+    size_t Size() const {
+        return size;
+    }
+
+private:
+    void* data = nullptr;
+    size_t size = 0;
+};
+
+//Returns the header if 'file' is a complete snapshot of the supported version, nullptr otherwise
+Header const* Validate(MappedFile const& file);
+
+}  // namespace snapshot
@@ -1,9 +1,15 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
 #include <cstdio>
+#include <functional>
+#include <limits>
 #include <memory>
-#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #if defined(PREFETCH_ENABLE_TRACE)
 #    include <glog/logging.h>
@@ -46,19 +52,19 @@ struct LimitedQueue {
     // Num of virtual iterms
     size_t _size = 0;
 
-    LimitedQueue(size_t s) : data(std::make_unique<T[]>(s)), _first(data.get()), _last(_first), _end(_first + s), _size() {}
+    LimitedQueue(size_t s) : data(Allocate(s)), _first(data.get()), _last(_first), _end(_first + s), _size() {}
 
-    LimitedQueue(size_t s, T const& t) : data(std::make_unique<T[]>(s)), _first(data.get()), _last(_first), _end(_first + s), _size() {
+    LimitedQueue(size_t s, T const& t) : data(Allocate(s)), _first(data.get()), _last(_first), _end(_first + s), _size() {
         std::fill_n(data.get(), s, t);  // no way to create std::unique_ptr<[]> with arguments in ctor
     }
 
     LimitedQueue(LimitedQueue const& q)
-        : data(std::make_unique<T[]>(q.Capacity())),
+        : data(Allocate(q.Capacity())),
           _first(data.get() + (q._first - q.data.get())),
           _last(data.get() + (q._last - q.data.get())),
           _end(data.get() + (q._end - q.data.get())),
           _size(q._size) {
-        std::copy_n(data.get(), Capacity(), q.data.get());
+        std::copy_n(q.data.get(), Capacity(), data.get());
     }
 
     LimitedQueue(LimitedQueue&& q) : data(std::move(q.data)), _first(q._first), _last(q._last), _end(q._end), _size(q._size) {
@@ -140,7 +146,20 @@ struct LimitedQueue {
         return Capacity() == Size();
     }
 
+    //Visits elements from the first to the last one
+    template <typename F>
+    void ForEach(F f) const {
+        T* p = _first;
+        for (size_t n = _size; n; --n, Increment(p))
+            f(static_cast<T const&>(*p));
+    }
+
 private:
+    //Empty queues (e.g. lookup keys) don't allocate
+    static std::unique_ptr<T[]> Allocate(size_t s) {
+        return s ? std::make_unique<T[]>(s) : nullptr;
+    }
+
     void Increment(T*& ptr) const {
         if (++ptr == _end)
             ptr = const_cast<T*>(data.get());
@@ -276,36 +295,432 @@ public:
     }
 };
 
+/* Stable LSD radix sort of 'index' by 'keys' (both are permuted), 8 bits per pass.
+   Passes over bytes higher than the maximal key's ones are skipped. 'k' and 'i' are scratch buffers */
+inline void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& index, std::vector<uint64_t>& k, std::vector<uint32_t>& i) {
+    auto size = keys.size();
+    assert(size == index.size());
+    auto max = size ? *std::max_element(std::begin(keys), std::end(keys)) : 0;
+
+    k.resize(size);
+    i.resize(size);
+    for (unsigned shift = 0; shift < 64 && (max >> shift); shift += 8) {
+        size_t offsets[256] = {};
+        for (auto key : keys)
+            ++offsets[(key >> shift) & 0xff];
+
+        for (size_t d = 0, sum = 0; d < 256; ++d)
+            sum += std::exchange(offsets[d], sum);
+
+        for (size_t n = 0; n < size; ++n) {
+            auto& o = offsets[(keys[n] >> shift) & 0xff];
+            k[o] = keys[n];
+            i[o] = index[n];
+            ++o;
+        }
+
+        keys.swap(k);
+        index.swap(i);
+    }
+}
+
+/* The largest 'n' in ['min', 'max'] for which monotone 'fits(n)' holds (e.g. tables of 'n' rows fit a memory budget),
+   zero if 'min' doesn't fit. 'n' is doubled from 'min' until it doesn't fit or exceeds 'max', then bisected */
+template <typename F>
+size_t LargestFitting(size_t min, size_t max, F fits) {
+    assert(min && min <= max && max < std::numeric_limits<size_t>::max() / 2);
+    if (!fits(min))
+        return 0;
+
+    size_t fit = min, exceeds = 2 * min;
+    for (; exceeds <= max && fits(exceeds); exceeds *= 2)
+        fit = exceeds;
+    exceeds = std::min(exceeds, max + 1);
+
+    while (exceeds - fit > 1) {
+        auto n = fit + (exceeds - fit) / 2;
+        (fits(n) ? fit : exceeds) = n;
+    }
+
+    return fit;
+}
+
+/* Fixed capacity row of a slab owned by a table (see 'Slab').
+   Moving a row swaps the storages, so records travel between tables' slots w/o allocation and copying.
+   Row w/o storage (e.g. a copy used as a key to search) moved into a slot leaves slot's storage in place */
+template <typename T>
+struct SlabRow {
+    T* data = nullptr;
+    uint32_t capacity = 0;
+    uint32_t count = 0;
+
+    SlabRow() = default;
+    SlabRow(T* d, size_t c) : data(d), capacity(uint32_t(c)) {}
+
+    //Copy has no storage
+    SlabRow(SlabRow const&) {}
+
+    SlabRow(SlabRow&& r) : data(r.data), capacity(r.capacity), count(r.count) {
+        r.data = nullptr;
+        r.capacity = r.count = 0;
+    }
+
+    SlabRow& operator=(SlabRow const& r) {
+        count = std::min(capacity, r.count);
+        std::copy_n(r.data, count, data);
+        return *this;
+    }
+
+    SlabRow& operator=(SlabRow&& r) {
+        if (this == &r)
+            return *this;
+
+        if (r.data) {
+            std::swap(data, r.data);
+            std::swap(capacity, r.capacity);
+        }
+        count = std::min(capacity, r.count);
+        r.count = 0;
+        return *this;
+    }
+
+    void push_back(T t) {
+        assert(count < capacity && "Slab row overflow");
+        if (count < capacity)
+            data[count++] = t;
+    }
+
+    T& operator[](size_t i) const {
+        return data[i];
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return !count;
+    }
+
+    void clear() {
+        count = 0;
+    }
+};
+
+//Contiguous storage of 'rows' rows of 'stride' elements
+template <typename T>
+struct Slab {
+    std::unique_ptr<T[]> data;
+    size_t stride;
+
+    Slab(size_t rows, size_t stride) : data(std::make_unique<T[]>(rows * stride)), stride(stride) {}
+
+    SlabRow<T> Row(size_t i) const {
+        return SlabRow<T>(data.get() + i * stride, stride);
+    }
+};
+
+/* Open addressing index of elements (Robin Hood probing, backward shift deletion, so no tombstones).
+   Elements are referenced by 32 bits index within one of two storages (the ring of 'LimitedHash' and
+   an optionally attached external one) and keep 32 bits of the hash, so probing doesn't touch elements
+   unless hashes are equal. Memory footprint is exactly 'Capacity(n) * sizeof(Slot)'.
+   Mimics 'std::unordered_set<T*>' using 'std::hash<T*>' and 'std::equal_to<T*>' for the keys */
+template <typename T>
+struct FlatHash {
+    struct Slot {
+        uint32_t ref;  // zero means empty
+        uint32_t hash;
+    };
+
+    using value_type = T*;
+
+    //Num of slots to keep 'n' elements (load factor is 0.8)
+    static constexpr size_t Capacity(size_t n) {
+        return n + n / 4 + 1;
+    }
+
+    //Bytes per element
+    static constexpr size_t entry_size = sizeof(Slot) + sizeof(Slot) / 4;
+
+    //Bytes allocated to keep 'n' elements
+    static constexpr size_t Footprint(size_t n) {
+        return n ? Capacity(n) * sizeof(Slot) : 0;
+    }
+
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity = 0;
+    size_t count = 0;
+
+    //Storages elements are referenced within
+    T* base[2] = {};
+    size_t length[2] = {};
+
+    //Index of no elements (e.g. of a lookup key) doesn't allocate
+    FlatHash(size_t n = 0) : slots(n ? std::make_unique<Slot[]>(Capacity(n)) : nullptr), capacity(n ? Capacity(n) : 0) {}
+
+    FlatHash(FlatHash const& h) : slots(h.capacity ? std::make_unique<Slot[]>(h.capacity) : nullptr), capacity(h.capacity), count(h.count) {
+        std::copy_n(h.slots.get(), capacity, slots.get());
+        std::copy_n(h.base, 2, base);
+        std::copy_n(h.length, 2, length);
+    }
+
+    FlatHash(FlatHash&&) = default;
+
+    FlatHash& operator=(FlatHash const& h) {
+        FlatHash t(h);
+        return *this = std::move(t);
+    }
+
+    FlatHash& operator=(FlatHash&&) = default;
+
+    void Bind(size_t storage, T* data, size_t size) {
+        assert(storage < 2);
+        base[storage] = data;
+        length[storage] = size;
+    }
+
+    //Re-allocates slots to keep 'n' elements
+    void Reserve(size_t n) {
+        FlatHash h(*this);
+        slots = std::make_unique<Slot[]>(Capacity(n));
+        capacity = Capacity(n);
+        count = 0;
+        for (size_t i = 0; i < h.capacity; ++i)
+            if (h.slots[i].ref)
+                Place(h.slots[i]);
+    }
+
+    T* find(T const* p) const {
+        auto pos = Lookup(p, Hash(p));
+        return pos != capacity ? Get(slots[pos].ref) : nullptr;
+    }
+
+    //Hints to load the home slot of 'p' ahead of 'find'/'insert'
+    void prefetch(T const* p) const {
+        if (capacity)
+            __builtin_prefetch(&slots[Home(Hash(p))]);
+    }
+
+    //Returns 'false' if an equal element is already there
+    bool insert(T* p) {
+        auto h = Hash(p);
+        if (Lookup(p, h) != capacity)
+            return false;
+
+        Place(Slot{ Ref(p), h });
+        return true;
+    }
+
+    //Removes the element equal to 'p'
+    size_t erase(T const* p) {
+        auto pos = Lookup(p, Hash(p));
+        if (pos == capacity)
+            return 0;
+
+        for (auto next = Next(pos); slots[next].ref && Distance(slots[next].hash, next); pos = next, next = Next(next))
+            slots[pos] = slots[next];
+
+        slots[pos] = Slot{};
+        --count;
+        return 1;
+    }
+
+    void clear() {
+        std::fill_n(slots.get(), capacity, Slot{});
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    class iterator {
+    public:
+        using self_type = iterator;
+        using value_type = T*;
+        using reference = T*;
+        using pointer = T**;
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = ptrdiff_t;
+
+        iterator(FlatHash const* container, size_t pos) : _container(container), _pos(pos) {
+            Skip();
+        }
+
+        iterator& operator++() {
+            ++_pos;
+            Skip();
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        reference operator*() const {
+            return _container->Get(_container->slots[_pos].ref);
+        }
+
+        bool operator==(const iterator& rhs) const {
+            return _pos == rhs._pos;
+        }
+        bool operator!=(const iterator& rhs) const {
+            return _pos != rhs._pos;
+        }
+
+    private:
+        void Skip() {
+            while (_pos < _container->capacity && !_container->slots[_pos].ref)
+                ++_pos;
+        }
+
+        FlatHash const* _container = nullptr;
+        size_t _pos = 0;
+    };
+
+    iterator begin() const {
+        return iterator(this, 0);
+    }
+
+    iterator end() const {
+        return iterator(this, capacity);
+    }
+
+private:
+    static constexpr uint32_t external = 1u << 31;
+
+    //'std::hash' of integers is identity, so mix it (murmur3 finalizer) before taking 32 bits
+    static uint32_t Hash(T const* p) {
+        uint64_t h = std::hash<T*>{}(const_cast<T*>(p));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return uint32_t(h);
+    }
+
+    size_t Home(uint32_t h) const {
+        return (uint64_t(h) * capacity) >> 32;
+    }
+
+    size_t Next(size_t pos) const {
+        return ++pos == capacity ? 0 : pos;
+    }
+
+    size_t Distance(uint32_t h, size_t pos) const {
+        auto home = Home(h);
+        return pos >= home ? pos - home : pos + capacity - home;
+    }
+
+    T* Get(uint32_t ref) const {
+        return ref & external ? base[1] + (ref & ~external) - 1 : base[0] + ref - 1;
+    }
+
+    uint32_t Ref(T const* p) const {
+        if (p >= base[0] && p < base[0] + length[0])
+            return uint32_t(p - base[0] + 1);
+
+        assert(p >= base[1] && p < base[1] + length[1] && "Element is out of bound storages");
+        return uint32_t(p - base[1] + 1) | external;
+    }
+
+    //Returns position of element equal to 'p' or 'capacity' if there is no one
+    size_t Lookup(T const* p, uint32_t h) const {
+        if (!count)
+            return capacity;
+
+        std::equal_to<T*> eq;
+        for (size_t pos = Home(h), d = 0;; pos = Next(pos), ++d) {
+            auto& s = slots[pos];
+            if (!s.ref || Distance(s.hash, pos) < d)
+                return capacity;
+
+            if (s.hash == h && eq(Get(s.ref), const_cast<T*>(p)))
+                return pos;
+        }
+    }
+
+    void Place(Slot s) {
+        assert(count < capacity);
+        for (size_t pos = Home(s.hash), d = 0;; pos = Next(pos), ++d) {
+            if (!slots[pos].ref) {
+                slots[pos] = s;
+                ++count;
+                return;
+            }
+
+            //take the place of the "richer" element and keep placing it
+            if (auto e = Distance(slots[pos].hash, pos); e < d) {
+                std::swap(slots[pos], s);
+                d = e;
+            }
+        }
+    }
+};
+
 //Requires bool 'Valid(T)'
 template <typename T>
 struct LimitedHash {
     using table_type = LimitedQueue<T>;
-    using hash_type = std::unordered_set<T*>;
+    using hash_type = FlatHash<T>;
 
     table_type table;
     hash_type hash;
 
-    LimitedHash(size_t _size) : table(_size) {
-        hash.reserve(_size);
+    //Bytes allocated by a table of 'n' elements (besides elements' own allocations)
+    static constexpr size_t Footprint(size_t n) {
+        return n * sizeof(T) + hash_type::Footprint(n);
     }
 
-    LimitedHash(size_t _size, T const& t) : table(_size, t) {
-        hash.reserve(_size);
+    LimitedHash(size_t _size) : table(_size), hash(_size) {
+        hash.Bind(0, table.data.get(), table.Capacity());
+    }
+
+    LimitedHash(size_t _size, T const& t) : table(_size, t), hash(_size) {
+        hash.Bind(0, table.data.get(), table.Capacity());
+    }
+
+    LimitedHash(LimitedHash const& h) : table(h.table), hash(h.hash) {
+        hash.Bind(0, table.data.get(), table.Capacity());
+    }
+
+    LimitedHash(LimitedHash&&) = default;
+
+    LimitedHash& operator=(LimitedHash const& h) {
+        table = h.table;
+        hash = h.hash;
+        hash.Bind(0, table.data.get(), table.Capacity());
+        return *this;
+    }
+
+    LimitedHash& operator=(LimitedHash&&) = default;
+
+    //Lets track elements of external storage 'q' as well (see 'Extract')
+    void Attach(LimitedQueue<T>& q) {
+        hash.Reserve(table.Capacity() + q.Capacity());
+        hash.Bind(1, q.data.get(), q.Capacity());
     }
 
     //Type 'U' should be convertible to 'T'
     template <typename U>
-    T* Find(U u) {
+    T* Find(U u) const {
+        T x{ u };
+        return hash.find(&x);
+    }
+
+    template <typename U>
+    void Prefetch(U u) const {
         T x{ u };
-        auto i = hash.find(&x);
-        return i != std::end(hash) ? *i : nullptr;
+        hash.prefetch(&x);
     }
 
     //Returns pointer to element and denoting whether the insertion took place
     std::pair<T*, bool> Push(T const& t) {
-        auto i = hash.find(const_cast<T*>(&t));
-        if (i != std::end(hash))
-            return std::make_pair(*i, false);
+        if (auto i = hash.find(&t))
+            return std::make_pair(i, false);
         else {
             if (Valid(*table._last))
                 hash.erase(table._last);
@@ -316,6 +731,13 @@ struct LimitedHash {
         }
     }
 
+    //Replaces element 'e' of the table by 't' (not equal to any other element)
+    void Replace(T* e, T const& t) {
+        hash.erase(e);
+        *e = t;
+        hash.insert(e);
+    }
+
     //Type 'U' should be convertible to 'T'
     //Returns pointer to element and  denoting whether the insertion took place
     template <typename U>
@@ -372,3 +794,149 @@ struct LimitedHash {
         return hash.size();
     }
 };
+
+/* Count-min sketch of recent frequencies of keys (TinyLFU): 4 rows of 8 bits saturating counters updated
+   conservatively (only the minimal ones grow). Every 'sample' additions the counters are halved, so the estimates
+   fade w/ age. Marked keys (e.g. too frequent ones) are kept by a Bloom filter of 2 hashes, it's cleared by aging too */
+struct FrequencySketch {
+    static constexpr size_t depth = 4;
+
+    //Width of a row to count 'n' distinct keys (power of two)
+    static size_t Width(size_t n) {
+        size_t w = 64;
+        while (w < n)
+            w *= 2;
+        return w;
+    }
+
+    //Bytes allocated to count 'n' distinct keys
+    static size_t Footprint(size_t n) {
+        return depth * Width(n) + Width(n);
+    }
+
+    FrequencySketch(size_t n)
+        : width(Width(n)),
+          counters(std::make_unique<uint8_t[]>(depth * width)),
+          marks(std::make_unique<uint8_t[]>(width)),
+          sample(10 * std::max<size_t>(1, n)) {}
+
+    //Counts 'key' once more, returns the estimate of its frequency
+    uint8_t Add(uint64_t key) {
+        if (++additions == sample)
+            Age();
+
+        size_t pos[depth];
+        Positions(key, pos);
+        uint8_t min = UINT8_MAX;
+        for (size_t i = 0; i < depth; ++i)
+            min = std::min(min, counters[pos[i]]);
+
+        if (min == UINT8_MAX)
+            return min;
+
+        for (size_t i = 0; i < depth; ++i)
+            if (counters[pos[i]] == min)
+                ++counters[pos[i]];
+
+        return min + 1;
+    }
+
+    void Mark(uint64_t key) {
+        auto h = Hash(key);
+        for (auto bit : { Bit(h), Bit(h >> 32) })
+            marks[bit / 8] |= uint8_t(1u << bit % 8);
+    }
+
+    //May be true for a key that isn't marked (w/ Bloom filter's probability)
+    bool Marked(uint64_t key) const {
+        auto h = Hash(key);
+        for (auto bit : { Bit(h), Bit(h >> 32) })
+            if (!(marks[bit / 8] & (1u << bit % 8)))
+                return false;
+        return true;
+    }
+
+private:
+    size_t width;
+    std::unique_ptr<uint8_t[]> counters;
+    std::unique_ptr<uint8_t[]> marks;  //'8 * width' bits
+    size_t sample;
+    size_t additions = 0;
+
+    //Keys are aligned addresses, so mix them (murmur3 finalizer)
+    static uint64_t Hash(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    //Counter of each row by double hashing
+    void Positions(uint64_t key, size_t* pos) const {
+        auto h = Hash(key);
+        auto lo = uint32_t(h), hi = uint32_t(h >> 32) | 1;
+        for (size_t i = 0; i < depth; ++i)
+            pos[i] = i * width + ((lo + i * hi) & (width - 1));
+    }
+
+    size_t Bit(uint64_t h) const {
+        return uint32_t(h) & (8 * width - 1);
+    }
+
+    void Age() {
+        additions = 0;
+        std::for_each(counters.get(), counters.get() + depth * width, [](auto& c) {
+            c /= 2;
+        });
+        std::fill_n(marks.get(), width, 0);
+    }
+};
+
+/* Bounded queue of one producer and one consumer thread w/o locks, elements are constructed once and reused.
+   The producer fills elements in place ('Back') and publishes them at once ('Commit'),
+   the consumer reads them in place ('Front') and releases them at once ('Pop') */
+template <typename T>
+struct SpscQueue {
+    std::vector<T> data;
+
+    SpscQueue(size_t s, T const& t = T()) : data(s, t) {}
+
+    size_t Capacity() const {
+        return data.size();
+    }
+
+    //Producer: num of elements which may be filled
+    size_t Free() const {
+        return data.size() - (tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire));
+    }
+
+    //Producer: 'i'-th element after the published ones
+    T& Back(size_t i) {
+        assert(i < Free());
+        return data[(tail.load(std::memory_order_relaxed) + i) % data.size()];
+    }
+
+    void Commit(size_t n) {
+        tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    //Consumer: num of published elements
+    size_t Size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);
+    }
+
+    T const& Front(size_t i) const {
+        return data[(head.load(std::memory_order_relaxed) + i) % data.size()];
+    }
+
+    void Pop(size_t n) {
+        head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+private:
+    //monotonic positions, producer and consumer don't share a cache line
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+};
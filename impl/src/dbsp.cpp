@@ -1,11 +1,17 @@
 #include "dbsp.h"
 
 #include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 
+#include "snapshot.h"
 #include "utils.h"
 
+//Num of requests ahead of the current one whose hash probes are prefetched in batches
+constexpr size_t prefetch_distance = 8;
+
 inline size_t calc_size(size_t old_size, size_t new_size, PredictorParams const& params) {
     size_t max_v = std::max(old_size, new_size);
     switch (params.req_size_update_policy) {
@@ -48,33 +54,44 @@ inline bool Valid(Entry<T> const& r) {
     return r.Valid();
 }
 
-namespace std {
-template <>
-struct hash<Request*> {
-    size_t operator()(Request const* r) const {
-        return hash<size_t>{}(r->start_addr_);
+//Keeps the strongest elements: 'replace(weakest)' is invoked if the queue is full and 'a' is stronger
+template <typename F>
+inline void OfferTop(LimitedQueue<PrefetchedRequest>& q, PrefetchedRequest const& a, F replace) {
+    if (!q.Full()) {
+        q.Push(a);
+        return;
     }
-};
 
-template <>
-struct equal_to<Request*> {
-    size_t operator()(Request const* l, Request const* r) const {
-        return r->start_addr_ == l->start_addr_;
-    }
-};
-}  // namespace std
+    auto weakest = std::min_element(q.data.get(), q.data.get() + q.Capacity(), [](auto& l, auto& r) {
+        return l.value < r.value;
+    });
+    if (weakest->value < a.value)
+        replace(weakest);
+}
 
-class Prediction;
+struct Prediction;
 
 class DBSP::RecordTable : private LimitedHash<Record> {
 public:
     using base = LimitedHash<Record>;
-    RecordTable(size_t size = 2048, size_t size_m_table = 2048) : base(size), m_table(size_m_table) {}
-
     using table_type = LimitedQueue<Record>;
     table_type m_table;
+    Slab<typename Record::TimeStamp> stamps;
+
+    RecordTable(size_t size, size_t size_m_table, size_t max_stamps)
+        : base(size),
+          m_table(size_m_table),
+          stamps(size + size_m_table, max_stamps) {
+        Attach(m_table);
+
+        for (size_t i = 0; i < size; ++i)
+            table.data[i].times = stamps.Row(i);
+        for (size_t i = 0; i < size_m_table; ++i)
+            m_table.data[i].times = stamps.Row(size + i);
+    }
 
-    void Insert(Request request, typename Record::TimeStamp ts, PredictorParams const& params) {
+    //Returns 'false' if the request is dropped as too frequent
+    bool Insert(Request request, typename Record::TimeStamp ts, PredictorParams const& params) {
         auto p = Push(request);
         auto r = p.first;
         DLOG(INFO) << FORMAT_REQUEST(r) << " is " << (p.second ? "inserted" : "found");
@@ -109,61 +126,281 @@ public:
                 hash.insert(r);
             }
             m_table.Pop();
+            return false;
         }
+
+        return true;
     }
 
+    //Stops tracking of mining table's requests, so they are read only while mining, and adds them to 'w'
+    void Detach(MiningWindow& w);
+
+    //Drops mined requests
+    void Reset() {
+        m_table.Clear();
+    }
+
+    //returns number of requests available for mining
+    size_t Available() const {
+        return m_table.Size();
+    }
+
+    bool Full() const {
+        return m_table.Full();
+    }
+
+    //Drops mined (reset) requests of the mining table, others are compacted keeping the order and tracked again
+    void Retain() {
+        auto d = std::begin(m_table);
+        size_t size = 0;
+        for (auto s = std::begin(m_table); s != std::end(m_table); ++s) {
+            if (!s->Valid())
+                continue;
+
+            if (&*d != &*s)
+                *d = std::move(*s);  //swaps stamps' storages
+            hash.insert(&*d);
+            ++d;
+            ++size;
+        }
+
+        while (m_table.Size() > size)
+            m_table.Pop();
+    }
+
+    //Visits valid records of the ring and then of the mining table
     template <typename F>
-    auto Process(PredictorParams const& p, F f) {
-        std::sort(std::begin(m_table), std::end(m_table), [](auto& l, auto& r) {
-            return l.Stamp(0) < r.Stamp(0);
+    void ForEach(F f) const {
+        auto valid = [&](Record const& r) {
+            if (r.Valid())
+                f(r);
+        };
+        table.ForEach(valid);
+        m_table.ForEach(valid);
+    }
+
+    //Restores a record of 'count' stamps, it is put to the mining table as 'Insert' does
+    void Restore(Request request, typename Record::TimeStamp const* stamps, size_t count, PredictorParams const& params) {
+        if (!count || count > params.max_support)
+            return;
+
+        bool mining = count >= params.min_support;
+        if (mining && m_table.Full())
+            return;
+
+        auto p = Push(request);
+        if (!p.second)
+            return;
+
+        std::for_each(stamps, stamps + count, [r = p.first](auto ts) {
+            r->Update(ts);
         });
 
-        auto r = std::begin(m_table), l = std::end(m_table);
-        for (; r != l; ++r) {
-            hash.erase(&(*r));
+        if (mining) {
+            auto location = m_table.Push(Record{});
+            Extract(p.first, *location);
+        }
+    }
 
-            bool first = true;
-            auto n = r;
-            LimitedQueue<Request> associations(p.pf_list_size);
-            for (++n; n != l; ++n) {
-                if ((*n).Stamp(0) - (*r).Stamp(0) > p.lookahead_range)
+    using base::Size;
+    using base::Find;
+    using base::Prefetch;
+};
+
+/* Requests under mining sorted by the first time stamp (radix sort) and kept as SoA,
+   so the sliding window scan touches only compact arrays of stamps and counts */
+struct DBSP::MiningWindow {
+    using TimeStamp = typename Record::TimeStamp;
+
+    std::vector<Record const*> rows;
+    std::vector<TimeStamp> first;
+    std::vector<uint32_t> count;
+
+    //Storage is reserved for 'size' rows, so it is never reallocated
+    MiningWindow(size_t size) {
+        for (auto v : { &rows, &r_scratch })
+            v->reserve(size);
+        for (auto v : { &keys, &k_scratch })
+            v->reserve(size);
+        for (auto v : { &order, &o_scratch, &count })
+            v->reserve(size);
+        first.reserve(size);
+    }
+
+    static constexpr size_t Footprint(size_t size) {
+        return size * (2 * sizeof(Record const*) + 2 * sizeof(uint64_t) + 3 * sizeof(uint32_t) + sizeof(TimeStamp));
+    }
+
+    void Clear() {
+        rows.clear();
+    }
+
+    void Add(Record const& r) {
+        rows.push_back(&r);
+    }
+
+    size_t Size() const {
+        return rows.size();
+    }
+
+    //Num of the oldest (sorted) rows whose lookahead window has passed by 'now', so no more neighbours may come
+    size_t Closed(TimeStamp now, size_t lookahead) const {
+        return std::partition_point(std::begin(first), std::end(first), [&](auto t) {
+                   return now - t > TimeStamp(lookahead);
+               }) -
+               std::begin(first);
+    }
+
+    //Marks 'mined' oldest (sorted) rows as mined (see 'RecordTable::Retain')
+    void Drop(size_t mined) {
+        std::for_each(std::begin(rows), std::begin(rows) + mined, [](auto r) {
+            r->Reset();
+        });
+    }
+
+    //Contiguous range of the 'mined' oldest rows handled by 'worker' of 'workers'
+    static std::pair<size_t, size_t> Range(size_t worker, size_t workers, size_t mined) {
+        auto chunk = (mined + workers - 1) / workers;
+        return { std::min(mined, worker * chunk), std::min(mined, (worker + 1) * chunk) };
+    }
+
+    /* Mines rows ['r', 'e') of the oldest ones (after 'Sort'), see 'Range' to split them between workers.
+       A range scans forward past its end (up to 'lookahead_range') over all rows, so windows overlap and
+       no association is lost at the boundaries. 'f(record, associations)' is invoked in the order of the range rows */
+    template <typename F>
+    void Process(PredictorParams const& p, size_t r, size_t e, F f) const {
+        auto size = rows.size();
+        LimitedQueue<PrefetchedRequest> associations(p.pf_list_size);
+        //'OriginalPaper' takes the first association and ones w/ min distance 1 (adjacent references), others take
+        //the strongest ones. Time stamps don't tell adjacent requests, so then it takes the first associations
+        bool original = Metrics::OriginalPaper == p.associations_metrics_type;
+        bool adjacent = original && ::TimeStamp::DoubleTime != p.ts_type;
+        bool scored = !original || p.is_priority_queue;
+        for (; r != e; ++r) {
+            bool found = false;
+            associations.Clear();
+            for (auto n = r + 1; n != size; ++n) {
+                if (first[n] - first[r] > p.lookahead_range)
                     break;
 
-                auto a = (*r).Association(*n, p.lookahead_range, p.confidence);
-                if (a) {
-                    bool add = first || std::get<0>(*a) == 1;
-                    if (first)
-                        first = false;
+                //'Association' fails on such rows anyway
+                if (size_t(std::abs(long(count[r]) - long(count[n]))) > p.confidence)
+                    continue;
+
+                //after the first association only ones w/ min distance 1 are added, it needs 2 stamps at least
+                if (adjacent && found && (count[r] < 2 || count[n] < 2)) {
+                    if (count[r] < 2)
+                        break;
+                    continue;
+                }
 
-                    if (add)
-                        associations.Push(*n);
+                auto a = rows[r]->Association(*rows[n], p.lookahead_range, p.confidence);
+                if (a) {
+                    bool add = !adjacent || !found || std::get<0>(*a) == 1;
+                    found = true;
+
+                    if (!add)
+                        continue;
+
+                    PrefetchedRequest c{ *rows[n], scored ? rows[r]->Score(*rows[n], p.associations_metrics_type) : 0, std::get<0>(*a) };
+                    if (original) {
+                        associations.Push(c);
+                        if (!adjacent && associations.Full())
+                            break;
+                    } else
+                        OfferTop(associations, c, [&](PrefetchedRequest* weakest) {
+                            *weakest = c;
+                        });
                 }
             }
 
-            f(*r, associations);
-        };
+            f(*rows[r], associations);
+        }
+    }
 
-        m_table.Clear();
-    };
+    void Sort() {
+        auto size = rows.size();
+        auto base = size ? (*std::min_element(std::begin(rows), std::end(rows), [](auto l, auto r) {
+                               return l->Stamp(0) < r->Stamp(0);
+                           }))->Stamp(0)
+                         : 0;
+
+        keys.resize(size);
+        order.resize(size);
+        for (size_t i = 0; i < size; ++i) {
+            keys[i] = uint64_t(rows[i]->Stamp(0) - base);
+            order[i] = uint32_t(i);
+        }
 
-    //returns number of requests available for mining
-    size_t Available() const {
-        return m_table.Size();
+        RadixSort(keys, order, k_scratch, o_scratch);
+
+        r_scratch.resize(size);
+        first.resize(size);
+        count.resize(size);
+        for (size_t i = 0; i < size; ++i) {
+            r_scratch[i] = rows[order[i]];
+            first[i] = r_scratch[i]->Stamp(0);
+            count[i] = uint32_t(r_scratch[i]->Count());
+        }
+        rows.swap(r_scratch);
     }
 
-    using base::Size;
-    using base::Find;
+private:
+    std::vector<uint64_t> keys, k_scratch;
+    std::vector<uint32_t> order, o_scratch;
+    std::vector<Record const*> r_scratch;
+};
+
+void DBSP::RecordTable::Detach(MiningWindow& w) {
+    std::for_each(std::begin(m_table), std::end(m_table), [&](auto& r) {
+        hash.erase(&r);
+        w.Add(r);
+    });
+}
+
+/* Association encoded relative to its source in sectors (or in bytes if unaligned, see 'bytes') or,
+   w/ 'far', referring to a far association by its index and its tag in the rest of 'sectors' */
+struct Association {
+    static constexpr uint32_t bytes = 1u << 31;  //flag of 'sectors' denoting byte units
+    static constexpr uint32_t far = 1u << 30;    //flag of 'sectors' denoting a far association
+    static constexpr uint32_t tags = far - 1;
+    static constexpr uint8_t initial_credit = 1;
+    static constexpr uint8_t max_credit = 3;
+
+    int32_t delta;     //in units from the source's start or index of the far association
+    uint32_t sectors;  //size in units or the tag of the far association
+    float value;        //score
+    uint8_t credit;     //prefetched blocks read minus ones wasted (saturated), see 'PrefetchTable::Apply'
+    uint16_t distance;  //min distance of stamps to the source's ones (saturated), zero if unknown
 };
 
-struct Prediction : Request {
-    using container_type = LimitedHash<Request>;
-    container_type associations;
+//Association which can't be encoded relative to its source, the entry is still its own if neither 'tag'
+//(see 'Association') nor 'source' differs
+struct FarAssociation {
+    uint64_t source;
+    uint64_t start_addr;
+    uint64_t size_bytes;
+    uint32_t tag;
+};
+
+//Source request w/ associations in a row of the table's slab (see 'PrefetchTable')
+struct Prediction {
+    size_t start_addr_ = 0;
+    size_t size_bytes_ = 0;
+    SlabRow<Association> associations;
+
+    Prediction() = default;
+    Prediction(Request const& r) : start_addr_(r.start_addr_), size_bytes_(r.size_bytes_) {}
 
-    Prediction() : Request(), associations(0) {}
-    Prediction(size_t size) : Request(), associations(size) {}
-    Prediction(Request r, size_t size) : Request(r), associations(size) {}
+    operator Request() const {
+        return Request{ start_addr_, size_bytes_ };
+    }
 };
 
+inline bool Valid(Prediction const& p) {
+    return p.size_bytes_ != 0;
+}
+
 namespace std {
 template <>
 struct hash<Prediction*> {
@@ -180,31 +417,167 @@ struct equal_to<Prediction*> {
 };
 }  // namespace std
 
+/* CLOCK replacement w/ use counters of querying predictions, shared by both instances of 'LeftRight'.
+   Readers count hits of slots, the writer picks victims (w/o recent hits) while modifying one instance
+   and the same victims are replayed on the other instance, so both have the same layout */
+struct DBSP::Clock {
+    static constexpr uint8_t max_uses = 3;
+
+    Clock(size_t size, size_t victims) : uses(new std::atomic<uint8_t>[size]), size(size) {
+        std::for_each(uses.get(), uses.get() + size, [](auto& u) {
+            u.store(0, std::memory_order_relaxed);
+        });
+        journal.reserve(victims);
+    }
+
+    static size_t Footprint(size_t size, size_t victims) {
+        return size * sizeof(std::atomic<uint8_t>) + victims * sizeof(uint32_t);
+    }
+
+    //Reader
+    void Touch(size_t slot) {
+        auto& u = uses[slot];
+        auto v = u.load(std::memory_order_relaxed);
+        if (v < max_uses)
+            u.store(v + 1, std::memory_order_relaxed);
+    }
+
+    //Writer: useful prefetch of a slot's associations, counted once for both instances
+    void Use(size_t slot) {
+        if (!replay)
+            Touch(slot);
+    }
+
+    //Writer: the next modification picks victims
+    void Record() {
+        journal.clear();
+        replayed = 0;
+        replay = false;
+    }
+
+    //Writer: the next modification takes the victims of the previous one
+    void Replay() {
+        replayed = 0;
+        replay = true;
+    }
+
+    size_t Victim() {
+        if (replay) {
+            assert(replayed < journal.size());
+            return journal[replayed++];
+        }
+
+        //each sweep decrements the counters, so it ends in 'max_uses + 1' sweeps at most
+        for (;; hand = (hand + 1) % size) {
+            auto& u = uses[hand];
+            auto v = u.load(std::memory_order_relaxed);
+            if (v) {
+                u.store(v - 1, std::memory_order_relaxed);
+                continue;
+            }
+
+            auto victim = hand;
+            hand = (hand + 1) % size;
+            journal.push_back(uint32_t(victim));
+            return victim;
+        }
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint8_t>[]> uses;
+    size_t size;
+    size_t hand = 0;
+    std::vector<uint32_t> journal;  //victims of the last modification
+    size_t replayed = 0;
+    bool replay = false;
+};
+
+/* Predictions w/ associations encoded compactly (see 'Association'), associations which don't fit
+   the encoding (unaligned or too far) are kept in a ring of far associations shared by all predictions.
+   The ring skips entries which are still referred to, so they are lost only if more of them are alive than it holds.
+   W/ 'block' predictions are also indexed by aligned blocks of their ranges, so 'Lookup' finds ones overlapping
+   a request which doesn't start as any of them. A range is fixed while its prediction is in the table,
+   so the index is updated only as slots are filled or replaced */
 struct DBSP::PrefetchTable : private LimitedHash<Prediction> {
     using base = LimitedHash<Prediction>;
     size_t limit;
+    bool priority;  //keep the strongest associations instead of the latest ones
+
+    //W/ 'clock' full table replaces its victims instead of the oldest predictions
+    PrefetchTable(size_t size, size_t limit, bool priority, Clock* clock = nullptr, size_t block = 0)
+        : base(size),
+          limit(limit),
+          priority(priority),
+          clock(clock),
+          slab(size, limit),
+          far(FarSize(size)),
+          block(block) {
+        for (size_t i = 0; i < size; ++i)
+            table.data[i].associations = slab.Row(i);
+        scratch.reserve(limit);
+
+        if (block) {
+            heads.assign(Buckets(size), none);
+            next.resize(size * max_blocks);
+        }
+    }
 
-    PrefetchTable(size_t size, size_t limit) : base(size, Prediction{ limit }), limit(limit) {}
+    //Bytes allocated by a table of 'size' predictions of 'limit' associations (indexed by 'block' if not zero)
+    static size_t Footprint(size_t size, size_t limit, size_t block = 0) {
+        auto index = block ? (Buckets(size) + size * max_blocks) * sizeof(uint32_t) : 0;
+        return base::Footprint(size) + (size + 1) * limit * sizeof(Association) + FarSize(size) * sizeof(FarAssociation) + index;
+    }
 
-    Prediction* Find(Request r) {
-        return base::Find(Prediction{ r, 0 });
+    Prediction const* Find(Request r) const {
+        return base::Find(Prediction{ r });
     }
 
-    Prediction* Push(Request r, Request a) {
-        auto p = base::Push(Prediction{ r, limit }).first;
-        assert(p);
-        p->associations.Push(a);
-        return p;
+    //Visits the prediction of 'r' or, if there is no one w/ 'block', predictions whose ranges overlap 'r'
+    template <typename F>
+    void Lookup(Request const& r, F f) const {
+        if (auto p = Find(r)) {
+            f(*p);
+            return;
+        }
+
+        if (!block)
+            return;
+
+        auto [first, last] = Blocks(r);
+        for (auto b = first; b <= last; ++b)
+            for (auto e = heads[Bucket(b)]; e != none; e = next[e]) {
+                auto& p = table.data[e / max_blocks];
+                //a prediction is indexed by each block of its range, so it's visited at the first common one
+                if (Blocks(p).first + e % max_blocks == b && p.start_addr_ < End(r) && r.start_addr_ < End(p) &&
+                    std::max(p.start_addr_, r.start_addr_) / block == b)
+                    f(p);
+            }
+    }
+
+    void Prefetch(Request r) const {
+        base::Prefetch(Prediction{ r });
     }
 
-    void Merge(PrefetchTable&& t) {
+    //Keeps 't', so the same merge can be replayed on another table
+    void Merge(PrefetchTable const& t) {
         std::for_each(std::begin(t.hash), std::end(t.hash), [&](auto x) {
-            if (0 == x->associations.Size())
+            if (0 == x->associations.size())
                 return;
 
-            auto p = base::Push(Prediction{ *x, limit }).first;
-            assert(p);
-            p->associations.Merge(std::move(x->associations));
+            auto p = Append(*x);
+            if (priority)
+                t.ForEach(*x, false, [&](auto const& a) {
+                    Offer(p, a);
+                });
+            else
+                Merge(p, t, *x);
+        });
+    }
+
+    //Moves all predictions from 't' keeping their order
+    void Append(PrefetchTable&& t) {
+        std::for_each(std::begin(t.table), std::end(t.table), [&](auto& x) {
+            Merge(Append(x), t, x);
         });
 
         t.Clear();
@@ -212,21 +585,135 @@ struct DBSP::PrefetchTable : private LimitedHash<Prediction> {
 
     void Clear() {
         base::Clear();
-        std::fill_n(table.data.get(), table.Capacity(), Prediction{ limit });
+        std::for_each(table.data.get(), table.data.get() + table.Capacity(), [](auto& p) {
+            p = Prediction{};  //keeps slab's row
+        });
+        std::fill(std::begin(heads), std::end(heads), none);
+    }
+
+    //Finds or adds (w/o associations) prediction of 'r'
+    Prediction* Append(Request r) {
+        Prediction x{ r };
+        if (auto p = base::Find(x))
+            return p;
+
+        //the oldest prediction (if the table is full) or the victim is replaced
+        Prediction* p;
+        if (!clock || !table.Full()) {
+            Unindex(*table._last);
+            p = base::Push(x).first;
+            assert(p);
+        } else {
+            p = &table.data[clock->Victim()];
+            Unindex(*p);
+            Replace(p, x);  //keeps slab's row
+        }
+
+        Index(*p);
+        return p;
+    }
+
+    //Counts a hit of 'p' for eviction
+    void Touch(Prediction const* p) const {
+        if (clock)
+            clock->Touch(p - table.data.get());
     }
 
     template <typename Iterator>
     Prediction* Append(Request r, Iterator begin, Iterator end) {
-        auto p = base::Push(Prediction{ r, limit }).first;
-        assert(p);
-        std::for_each(begin, end, [p](auto a) {
+        auto p = Append(r);
+        std::for_each(begin, end, [&](auto const& a) {
             if (Valid(a))
-                p->associations.Push(a);
+                Offer(p, a);
         });
 
         return p;
     }
 
+    //Adds association 'a' to 'p', w/ 'priority' the strongest ones are kept instead of the latest ones
+    void Offer(Prediction* p, PrefetchedRequest const& a) {
+        auto& row = p->associations;
+        auto e = Find(*p, a);
+        if (!priority) {
+            if (e)
+                return;
+
+            //the oldest one is dropped
+            if (row.size() == row.capacity) {
+                std::copy(&row[1], &row[0] + row.size(), &row[0]);
+                row.count--;
+            }
+            row.push_back(Encode(*p, a));
+            return;
+        }
+
+        if (e) {
+            e->value = float(a.value);
+            e->distance = Distance(a);
+            return;
+        }
+
+        if (row.size() < row.capacity) {
+            row.push_back(Encode(*p, a));
+            return;
+        }
+
+        //lost far associations are replaced first
+        Association* weakest = nullptr;
+        PrefetchedRequest x{};
+        for (size_t i = 0; i < row.size(); ++i) {
+            if (!Decode(*p, row[i], x)) {
+                weakest = &row[i];
+                break;
+            }
+            if (!weakest || row[i].value < weakest->value)
+                weakest = &row[i];
+        }
+
+        if (!Decode(*p, *weakest, x) || weakest->value < float(a.value))
+            *weakest = Encode(*p, a);
+    }
+
+    /* Applies cache's feedback to associations whose range has the block: a useful block adds credit,
+       a wasted one takes it (and halves the score w/ 'priority') or drops the association w/o credit */
+    void Apply(std::vector<Feedback> const& feedback) {
+        PrefetchedRequest a{};
+        for (auto& f : feedback) {
+            auto p = base::Find(Prediction{ Request{ f.source } });
+            if (!p)
+                continue;
+
+            auto& row = p->associations;
+            for (size_t i = 0; i < row.size(); ++i) {
+                if (!Decode(*p, row[i], a) || f.block < a.start_addr_ || f.block >= a.start_addr_ + a.size_bytes_)
+                    continue;
+
+                auto& e = row[i];
+                if (f.useful) {
+                    e.credit = std::min<uint8_t>(e.credit + 1, Association::max_credit);
+                    //a source whose prefetches hit isn't evicted by the following merge
+                    if (clock)
+                        clock->Use(p - table.data.get());
+                } else if (e.credit) {
+                    --e.credit;
+                    if (priority)
+                        e.value /= 2;
+                } else {
+                    VLOG(2) << "Drop wasting association #" << i << " of " << FORMAT_REQUEST(p);
+                    std::copy(&row[0] + i + 1, &row[0] + row.size(), &row[0] + i);
+                    row.count--;
+                }
+                break;
+            }
+        }
+    }
+
+    //Visits valid associations of 'p', w/ 'priority' in order of their score (the strongest first)
+    template <typename F>
+    void ForEach(Prediction const& p, F f) const {
+        ForEach(p, priority, f);
+    }
+
     template <typename F>
     void Notify(PredictorParams const& p, F f) {
         std::vector<Request> associations;
@@ -235,18 +722,421 @@ struct DBSP::PrefetchTable : private LimitedHash<Prediction> {
         std::for_each(std::begin(hash), std::end(hash), [&](auto p) {
             associations.clear();
             //notify only valid associations
-            std::copy_if(std::begin(p->associations.table), std::end(p->associations.table), std::back_inserter(associations), [](auto r) {
-                return Valid(r);
+            ForEach(*p, [&](auto const& a) {
+                associations.push_back(a);
             });
 
             f(*p, std::data(associations), std::size(associations));
         });
     }
 
+    //Visits valid predictions from the oldest one
+    template <typename F>
+    void ForEach(F f) const {
+        table.ForEach([&](Prediction const& p) {
+            if (Valid(p))
+                f(p);
+        });
+    }
+
     using base::Size;
+
+private:
+    static constexpr size_t sector_size = 512;
+    //entries probed for a free one, the ring holds a far association per prediction, so a working set of
+    //predictions which mostly jump to a single far region fits it and a probe finds a free entry soon
+    static constexpr size_t far_probes = 16;
+    //blocks of a range indexed or looked up, the rest of a longer range is ignored
+    static constexpr size_t max_blocks = 8;
+
+    Clock* clock;
+    Slab<Association> slab;
+    std::vector<FarAssociation> far;
+    size_t far_next = 0;
+    uint32_t far_tag = 0;  //of the last entry written
+    std::vector<Association> scratch;  //own associations while merging
+
+    //'k'-th block of the prediction of slot 's' is entry 's * max_blocks + k' of its bucket's list
+    static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+    size_t block;
+    std::vector<uint32_t> heads;  //bucket => its first entry
+    std::vector<uint32_t> next;   //entry => the next one of its bucket
+
+    static size_t FarSize(size_t size) {
+        return std::min<size_t>(size + 1, std::numeric_limits<int32_t>::max());
+    }
+
+    static size_t Buckets(size_t size) {
+        size_t n = 1;
+        while (n < size)
+            n *= 2;
+        return n;
+    }
+
+    static size_t End(Request const& r) {
+        return r.start_addr_ + std::max<size_t>(1, r.size_bytes_);
+    }
+
+    std::pair<size_t, size_t> Blocks(Request const& r) const {
+        auto first = r.start_addr_ / block;
+        return { first, std::min((End(r) - 1) / block, first + max_blocks - 1) };
+    }
+
+    //Blocks are consecutive, so mix them (Fibonacci hashing)
+    size_t Bucket(size_t b) const {
+        return ((b * 0x9E3779B97F4A7C15ull) >> 32) & (heads.size() - 1);
+    }
+
+    void Index(Prediction const& p) {
+        if (!block || !Valid(p))
+            return;
+
+        auto e = uint32_t(&p - table.data.get()) * max_blocks;
+        auto [first, last] = Blocks(p);
+        for (auto b = first; b <= last; ++b, ++e) {
+            auto& head = heads[Bucket(b)];
+            next[e] = std::exchange(head, e);
+        }
+    }
+
+    //Buckets are short, so an entry is unlinked by a scan of its bucket
+    void Unindex(Prediction const& p) {
+        if (!block || !Valid(p))
+            return;
+
+        auto e = uint32_t(&p - table.data.get()) * max_blocks;
+        auto [first, last] = Blocks(p);
+        for (auto b = first; b <= last; ++b, ++e) {
+            auto link = &heads[Bucket(b)];
+            while (*link != e)
+                link = &next[*link];
+            *link = next[e];
+        }
+    }
+
+    Association Encode(Prediction const& p, PrefetchedRequest const& a) {
+        auto fits = [](int64_t delta, size_t size) {
+            return size < Association::far && delta >= std::numeric_limits<int32_t>::min() && delta <= std::numeric_limits<int32_t>::max();
+        };
+
+        auto delta = int64_t(a.start_addr_) - int64_t(p.start_addr_);
+        bool aligned = 0 == (a.start_addr_ | p.start_addr_ | a.size_bytes_) % sector_size;
+        if (aligned && fits(delta / int64_t(sector_size), a.size_bytes_ / sector_size))
+            return Association{ int32_t(delta / int64_t(sector_size)), uint32_t(a.size_bytes_ / sector_size), float(a.value), Association::initial_credit, Distance(a) };
+        if (fits(delta, a.size_bytes_))
+            return Association{ int32_t(delta), uint32_t(a.size_bytes_) | Association::bytes, float(a.value), Association::initial_credit, Distance(a) };
+
+        //entries alive are skipped, the oldest probed one is overwritten if all of them are
+        auto i = far_next;
+        for (size_t n = 1; n < far_probes && Alive(far_next, p); ++n)
+            far_next = (far_next + 1) % far.size();
+        if (Alive(far_next, p))
+            far_next = i;
+
+        i = far_next;
+        far_next = (far_next + 1) % far.size();
+        far_tag = (far_tag + 1) & Association::tags;
+        far[i] = FarAssociation{ p.start_addr_, a.start_addr_, a.size_bytes_, far_tag };
+        return Association{ int32_t(i), Association::far | far_tag, float(a.value), Association::initial_credit, Distance(a) };
+    }
+
+    //Whether far entry 'i' is referred to by its source's prediction, 'p' is being encoded w/ its own ones in 'scratch'
+    bool Alive(size_t i, Prediction const& p) const {
+        auto& x = far[i];
+        auto refers = [&](Association const& e) {
+            return (e.sectors & Association::far) && uint32_t(e.delta) == i && (e.sectors & Association::tags) == x.tag;
+        };
+
+        if (x.source == p.start_addr_ && std::any_of(std::begin(scratch), std::end(scratch), refers))
+            return true;
+
+        auto s = base::Find(Prediction{ Request{ x.source } });
+        return s && std::any_of(&s->associations[0], &s->associations[0] + s->associations.size(), refers);
+    }
+
+    static uint16_t Distance(PrefetchedRequest const& a) {
+        return uint16_t(std::min<size_t>(a.distance, std::numeric_limits<uint16_t>::max()));
+    }
+
+    //Returns false if the far association is lost
+    bool Decode(Prediction const& p, Association const& e, PrefetchedRequest& a) const {
+        if (!(e.sectors & Association::far)) {
+            int64_t unit = e.sectors & Association::bytes ? 1 : sector_size;
+            a = PrefetchedRequest{ Request{ size_t(int64_t(p.start_addr_) + e.delta * unit), size_t(e.sectors & ~Association::bytes) * unit }, e.value, e.distance };
+            return true;
+        }
+
+        auto& x = far[uint32_t(e.delta)];
+        if ((e.sectors & Association::tags) != x.tag || x.source != p.start_addr_)
+            return false;
+
+        a = PrefetchedRequest{ Request{ x.start_addr, x.size_bytes }, e.value, e.distance };
+        return true;
+    }
+
+    //Linear search by start (as keys of the tables), the list is short
+    Association* Find(Prediction& p, Request const& a) {
+        PrefetchedRequest x{};
+        for (size_t i = 0; i < p.associations.size(); ++i)
+            if (Decode(p, p.associations[i], x) && x.start_addr_ == a.start_addr_)
+                return &p.associations[i];
+
+        return nullptr;
+    }
+
+    template <typename F>
+    void ForEach(Prediction const& p, bool priority, F f) const {
+        auto& row = p.associations;
+        PrefetchedRequest a{};
+        if (!priority) {
+            for (size_t i = 0; i < row.size(); ++i)
+                if (Decode(p, row[i], a))
+                    f(a);
+            return;
+        }
+
+        //selection by score
+        for (Association const* last = nullptr;;) {
+            Association const* next = nullptr;
+            for (auto e = &row[0]; e != &row[0] + row.size(); ++e) {
+                //already visited
+                if (last && (e->value > last->value || (e->value == last->value && e <= last)))
+                    continue;
+                if ((!next || e->value > next->value) && Decode(p, *e, a))
+                    next = e;
+            }
+
+            if (!next)
+                break;
+
+            Decode(p, *next, a);
+            f(a);
+            last = next;
+        }
+    }
+
+    /* Associations of 'x' of table 't' go first followed by the own ones of 'p' while there is room,
+       as 'LimitedHash::Merge' does */
+    void Merge(Prediction* p, PrefetchTable const& t, Prediction const& x) {
+        auto& row = p->associations;
+        scratch.assign(&row[0], &row[0] + row.size());
+
+        //credit of own ones is kept, so is the entry of a far one
+        PrefetchedRequest a{};
+        row.clear();
+        t.ForEach(x, false, [&](auto const& n) {
+            auto o = std::find_if(std::begin(scratch), std::end(scratch), [&](auto const& o) {
+                return Decode(*p, o, a) && a.start_addr_ == n.start_addr_;
+            });
+
+            if (o == std::end(scratch)) {
+                row.push_back(Encode(*p, n));
+                return;
+            }
+
+            auto e = (o->sectors & Association::far) && a.size_bytes_ == n.size_bytes_ ? *o : Encode(*p, n);
+            e.value = float(n.value);
+            e.distance = Distance(n);
+            e.credit = o->credit;
+            row.push_back(e);
+        });
+
+        //own ones are kept encoded
+        for (auto& e : scratch) {
+            if (row.size() == row.capacity)
+                break;
+            if (Decode(*p, e, a) && !Find(*p, a))
+                row.push_back(e);
+        }
+        scratch.clear();
+    }
+};
+
+/* Notifications of a subscriber. W/ 'notify_queue_size' mining queues them (a batch per mining round) and
+   the subscriber's thread delivers them ('Drain'), otherwise they are delivered from mining at once */
+struct DBSP::Subscriber {
+    struct Notification {
+        Request request;
+        std::vector<Request> associations;
+    };
+
+    std::function<PredictorNotify> callback;
+    SpscQueue<Notification> queue;
+    std::unique_ptr<PrefetchTable> pending;  //coalesced notifications which didn't fit the queue
+    size_t staged = 0;                       //filled, but not yet published
+
+    Subscriber(std::function<PredictorNotify> f, PredictorParams const& p) : callback(std::move(f)), queue(p.notify_queue_size) {
+        //no allocation while queuing
+        for (size_t i = 0; i < queue.Capacity(); ++i)
+            queue.Back(i).associations.reserve(p.pf_list_size);
+
+        if (queue.Capacity() && NotifyOverflowCoalesce == p.notify_overflow)
+            pending.reset(new PrefetchTable(p.notify_queue_size, p.pf_list_size, false));
+    }
+
+    //Mining: queues the notification (it's visible to the subscriber after 'Commit') or delivers it at once
+    void Offer(Request r, Request const* associations, size_t size) {
+        if (!queue.Capacity()) {
+            callback(r, associations, size);
+            return;
+        }
+
+        //coalesced notifications go first, so the new one waits for them
+        if ((!pending || !pending->Size()) && staged < queue.Free()) {
+            auto& n = queue.Back(staged++);
+            n.request = r;
+            n.associations.assign(associations, associations + size);
+        } else if (pending) {
+            auto p = pending->Append(r);
+            std::for_each(associations, associations + size, [&](auto const& a) {
+                pending->Offer(p, PrefetchedRequest{ a, 0, 0 });
+            });
+        } else
+            VLOG(2) << "Drop notification for request " << FORMAT_REQUEST((&r));
+    }
+
+    //Mining: queues coalesced notifications once all of them fit the queue
+    void Flush() {
+        if (!pending || !pending->Size() || pending->Size() > queue.Free() - staged)
+            return;
+
+        pending->ForEach([&](Prediction const& p) {
+            auto& n = queue.Back(staged++);
+            n.request = p;
+            n.associations.clear();
+            pending->ForEach(p, [&](auto const& a) {
+                n.associations.push_back(a);
+            });
+        });
+        pending->Clear();
+    }
+
+    void Commit() {
+        queue.Commit(staged);
+        staged = 0;
+    }
+
+    //Subscriber's thread
+    size_t Drain(size_t limit) {
+        auto size = std::min(queue.Size(), limit);
+        for (size_t i = 0; i < size; ++i) {
+            auto& n = queue.Front(i);
+            callback(n.request, std::data(n.associations), std::size(n.associations));
+        }
+
+        queue.Pop(size);
+        return size;
+    }
+};
+
+/* Recorded requests of a range of addresses. Producers lock only the partition of a request, while
+   a mining round takes mining tables of all partitions, so associations are mined on the global timeline */
+struct alignas(64) DBSP::Partition {
+    std::unique_ptr<RecordTable> requests[2];
+    RecordTable* r_requests;  //recording requests
+    RecordTable* m_requests;  //mining requests
+    std::unique_ptr<FrequencySketch> admission;  //of recent requests w/ 'admission_count', shared by both tables
+    //w/ 'PredictorAlgoLookAhead' streams of the region of addresses (see 'StreamsOf') predict strided requests,
+    //so only sporadic ones are mined. Updates are under the partition's lock, predictions don't lock
+    std::unique_ptr<StreamDetector> streams;
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    std::mutex mutex;  //compute guard
+#endif
+
+    //A request is recorded once it's seen 'count' times recently unless it's already tracked,
+    //too frequent ones aren't recorded again until the sketch ages
+    bool Admit(Request const& r, size_t count) {
+        if (!admission)
+            return true;
+
+        if (admission->Marked(r.start_addr_))
+            return false;
+
+        return admission->Add(r.start_addr_) >= count || r_requests->Find(r);
+    }
 };
 
-DBSP::DBSP(const PredictorParams&){};
+namespace {
+constexpr size_t default_partition_count = 8;
+
+size_t partition_count(PredictorParams const& p, bool partitioned) {
+    return partitioned ? (p.partition_count ? p.partition_count : default_partition_count) : 1;
+}
+
+//rows of a partition's record/mining table, the tables are split evenly
+size_t partition_rows(size_t rows, PredictorParams const& p) {
+    auto count = std::max<size_t>(1, p.partition_count);
+    return (rows + count - 1) / count;
+}
+
+//rows of a mining round (of all partitions)
+size_t mining_rows(PredictorParams const& p) {
+    return std::max<size_t>(1, p.partition_count) * partition_rows(p.mining_table_num_rows, p);
+}
+
+//cache's feedback kept between publications, the excess is lost
+size_t feedback_size(PredictorParams const& p) {
+    return mining_rows(p) * std::max<size_t>(1, p.pf_list_size);
+}
+}  // namespace
+
+DBSP::DBSP(const PredictorParams& p, bool partitioned) : predicor_params(p), partitioned(partitioned){};
+
+DBSP::Partition& DBSP::PartitionOf(Request const& r) const {
+    if (partitions.size() == 1)
+        return *partitions[0];
+
+    //addresses are aligned, so mix them first (Fibonacci hashing)
+    return *partitions[((r.start_addr_ * 0x9E3779B97F4A7C15ull) >> 32) % partitions.size()];
+}
+
+//Streams are tracked by regions of addresses rather than by addresses, so a strided stream isn't split among partitions
+DBSP::Partition& DBSP::StreamsOf(Request const& r) const {
+    constexpr size_t region_bits = 26;  //64MiB
+
+    if (partitions.size() == 1)
+        return *partitions[0];
+
+    return *partitions[(((r.start_addr_ >> region_bits) * 0x9E3779B97F4A7C15ull) >> 32) % partitions.size()];
+}
+
+//'p.partition_count' is expected as 'init' sets it (one for not partitioned predictor)
+size_t DBSP::Footprint(PredictorParams const& p) {
+    size_t threads = p.thread_count;
+#if !defined(PREFETCH_ENABLE_MULTI_THREADED)
+    threads = 0;
+#endif
+    auto count = std::max<size_t>(1, p.partition_count);
+    auto rows = mining_rows(p);
+
+    auto stamps = p.max_support + 1;
+    auto record_table = [&](size_t rows, size_t m_rows) {
+        //ring and mining table share the index and the slab of stamps
+        return (rows + m_rows) * (sizeof(Record) + stamps * sizeof(Record::TimeStamp)) + FlatHash<Record>::Footprint(rows + m_rows);
+    };
+
+    auto prefetch_table = [&](size_t rows) {
+        return PrefetchTable::Footprint(rows, p.pf_list_size);
+    };
+
+    size_t bytes = sizeof(DBSP) + count * (sizeof(Partition) + sizeof(std::unique_ptr<Partition>));
+    bytes += count * (threads ? 2 : 1) * record_table(partition_rows(p.record_table_num_rows, p), partition_rows(p.mining_table_num_rows, p));
+    if (p.admission_count > 1)
+        bytes += count * FrequencySketch::Footprint(partition_rows(p.record_table_num_rows, p));
+    bytes += 2 * PrefetchTable::Footprint(p.prefetch_table_num_rows, p.pf_list_size, p.overlap_block_size);  //see 'LeftRight'
+    if (p.prediction_eviction == PredictionEvictionClock)
+        bytes += Clock::Footprint(p.prefetch_table_num_rows, rows);
+    bytes += prefetch_table(rows);
+    for (size_t i = 1; i < threads; ++i)
+        bytes += prefetch_table((rows + threads - 1) / threads);
+
+    bytes += MiningWindow::Footprint(rows);
+    bytes += 2 * feedback_size(p) * sizeof(Feedback);  //reported and applied ones
+    if (p.algo & PredictorAlgoLookAhead)
+        bytes += count * StreamDetector::Footprint(p);
+    bytes += std::max<size_t>(1, threads) * p.pf_list_size * sizeof(PrefetchedRequest);  //associations of mining workers
+    return bytes;
+}
 
 PredictorParams DBSP::get_params(size_t bytes_total_size) {
     constexpr size_t default_pf_list_size = 2;
@@ -256,81 +1146,66 @@ PredictorParams DBSP::get_params(size_t bytes_total_size) {
 #else
     constexpr size_t default_thread_count = 0;
 #endif
-    // Let's define record/prefetch records length ratio as 5%. Need to keep in mind that we may have two record tables.
-    constexpr auto record_prefech_tables_ratio = 5. / 100 * (default_thread_count ? 2 : 1);
-
-    static_assert(std::is_same_v<RecordTable::base::table_type::value_type, Record>, "Type shall be Record");
-    static_assert(std::is_same_v<RecordTable::base::hash_type::value_type, Record*>, "Type shall be Record*");
-    static_assert(sizeof(std::__detail::_Hash_node<RecordTable::base::hash_type::value_type, true>) == 24, "Unexpected size");
-    constexpr size_t record_table_entry_size = sizeof(RecordTable::base::table_type::value_type) +
-                                               sizeof(std::__detail::_Hash_node<RecordTable::base::hash_type::value_type, true>) +
-                                               // this one allocated by hash.bucket_count() value but we don't know exact num of buckets in advance :
-                                               sizeof(std::__detail::_Hash_node_base*);
-    constexpr size_t mining_table_entry_size = sizeof(RecordTable::table_type::value_type);
-
-    static_assert(std::is_same_v<Prediction::container_type::table_type::value_type, Request>, "Type shall be Request");
-    static_assert(std::is_same_v<Prediction::container_type::hash_type::value_type, Request*>, "Type shall be Request*");
-    static_assert(sizeof(std::__detail::_Hash_node<Prediction::container_type::hash_type::value_type, true>) == 24, "Unexpected size");
-    constexpr size_t prediction_entry_size = sizeof(Prediction) + sizeof(Prediction::container_type::table_type::value_type) * default_pf_list_size +
-                                             sizeof(std::__detail::_Hash_node<Prediction::container_type::hash_type::value_type, true>) * default_pf_list_size +
-                                             sizeof(std::__detail::_Hash_node_base*) * /* actually shall be 'hash.bucket_count()' */ default_pf_list_size;
-    constexpr size_t prefetch_table_entry_size =
-        prediction_entry_size + sizeof(std::__detail::_Hash_node<Prediction*, true>) + sizeof(std::__detail::_Hash_node_base*);
-
-    PredictorParams par = {};
-    par.req_size_update_policy = RequestSizeUpdatePolicy::UpdateWithLargest;
-    par.limit_size_for_size_policy = 51200;
-    par.thread_count = default_thread_count;
-    par.min_support = 1;
-    par.max_support = 13;
-    par.lookahead_range = 160;
-    par.pf_list_size = default_pf_list_size;
-    par.mining_table_num_rows = default_mining_table_num_rows;
-    par.confidence = 0;
-
-    constexpr auto min_prefetch_entries = 1000U;
-    constexpr size_t min_required_size = (prefetch_table_entry_size + mining_table_entry_size) * default_mining_table_num_rows +
-                                         min_prefetch_entries * prefetch_table_entry_size +
-                                         min_prefetch_entries * record_prefech_tables_ratio * record_table_entry_size;
-
-    if (bytes_total_size < min_required_size)
-        return {};
-
-    size_t remaining_bytes = bytes_total_size - (mining_table_entry_size * par.mining_table_num_rows) -
-                             (prefetch_table_entry_size * par.mining_table_num_rows) /* since we allocate two PrefetchTable's*/;
-
-    // Equation of two vars 'record_table_num_rows' and 'prefetch_table_num_rows':
-    //  bytes = record_table_num_rows * record_table_entry_size + prefetch_table_num_rows * prefetch_table_entry_size
-    //  record_prefech_tables_ratio = record_table_num_rows / prefetch_table_num_rows
+    // Let's define record/prefetch records length ratio as 5% (per record table).
+    constexpr auto record_prefech_tables_ratio = 5. / 100;
+    constexpr size_t default_max_support = 13;
+    constexpr size_t default_lookahead_range = 160;
+
+    PredictorParams par = predicor_params;
+    //a predictor created w/o params gets the default ones
+    if (!par.max_support) {
+        par.req_size_update_policy = RequestSizeUpdatePolicy::UpdateWithLargest;
+        par.limit_size_for_size_policy = 51200;
+        par.thread_count = default_thread_count;
+        par.min_support = 1;
+        par.max_support = default_max_support;
+    }
+    if (!par.lookahead_range)
+        par.lookahead_range = default_lookahead_range;
+    if (!par.pf_list_size)
+        par.pf_list_size = default_pf_list_size;
+    if (!par.mining_table_num_rows)
+        par.mining_table_num_rows = default_mining_table_num_rows;
+    par.partition_count = partition_count(predicor_params, partitioned);
+
+    auto fit = [&](size_t prefetch_table_num_rows) {
+        par.prefetch_table_num_rows = prefetch_table_num_rows;
+        par.record_table_num_rows = prefetch_table_num_rows * record_prefech_tables_ratio;
+        return Footprint(par) <= bytes_total_size;
+    };
 
-    // for simplicity let's express just for the prefetch table ...
-    constexpr auto prefetch_table_coeff = 1 / (record_table_entry_size * record_prefech_tables_ratio + prefetch_table_entry_size);
-    par.prefetch_table_num_rows = remaining_bytes * prefetch_table_coeff;
-    remaining_bytes -= par.prefetch_table_num_rows * prefetch_table_entry_size;
-    // .. and calc record table via remaining size
-    par.record_table_num_rows = remaining_bytes / record_table_entry_size;
+    constexpr size_t min_prefetch_entries = 1000;
+    //slots (and entries of the block index) are 32 bits
+    constexpr size_t max_prefetch_entries = size_t(1) << 28;
 
-    if (default_thread_count) {
-        // Since we have two tables, record_prefech_tables_ratio was increased 2x times.
-        // So need to dictribute table length to two tables back:
-        par.record_table_num_rows /= 2;
-    }
+    // Footprint grows with tables' rows, so look for the largest fitting ones
+    auto rows = LargestFitting(min_prefetch_entries, max_prefetch_entries, fit);
+    if (!rows)
+        return {};
 
+    fit(rows);
     return par;
 }
 
 int DBSP::init(const PredictorParams& var) {
     predicor_params = var;
+    predicor_params.partition_count = partition_count(var, partitioned);
 
     ts = 0;
-    size_t rsize = sizeof(Record) + sizeof(typename Record::TimeStamp) * predicor_params.max_support;
+    origin = std::chrono::steady_clock::now();
+    size_t rsize = sizeof(Record) + sizeof(typename Record::TimeStamp) * (predicor_params.max_support + 1);
     size_t psize = sizeof(Prediction) + sizeof(Request) * predicor_params.pf_list_size;
     LOG(INFO) << "Constructing w/ params:"
+              << "\n\tassociation kernel {" << simd::Name() << "}"
               << "\n\tmining_table_num_rows {" << predicor_params.mining_table_num_rows << "}"
+              << "\n\ttime stamp {" << (TimeStamp::DoubleTime == predicor_params.ts_type ? "time" : "counter") << "}"
               << "\n\tmin/max {" << predicor_params.min_support << "," << predicor_params.max_support << "}"
+              << "\n\tpartitions {" << predicor_params.partition_count << "}"
+              << "\n\tadmission {" << predicor_params.admission_count << "}"
               << "\n\tRT element/size/rows {" << sizeof(Record) << "," << rsize << "," << predicor_params.record_table_num_rows << "}"
               << "\n\tMT element/size/rows {" << sizeof(Record) << "," << rsize << "," << predicor_params.mining_table_num_rows << "}"
-              << "\n\tRT element/size/rows {" << sizeof(Prediction) << "," << psize << "," << predicor_params.prefetch_table_num_rows << "}";
+              << "\n\tRT element/size/rows {" << sizeof(Prediction) << "," << psize << "," << predicor_params.prefetch_table_num_rows << "}"
+              << "\n\tfootprint {" << Footprint(predicor_params) << "}";
 
 #if !defined(PREFETCH_ENABLE_MULTI_THREADED)
     if (predicor_params.thread_count > 0) {
@@ -339,35 +1214,208 @@ int DBSP::init(const PredictorParams& var) {
     }
 #endif
 
+    auto rows = partition_rows(predicor_params.record_table_num_rows, predicor_params);
+    auto m_rows = partition_rows(predicor_params.mining_table_num_rows, predicor_params);
+    auto record_table = [&]() {
+        return std::make_unique<RecordTable>(rows, m_rows, predicor_params.max_support + 1);
+    };
+
+    partitions.resize(predicor_params.partition_count);
+    std::generate(std::begin(partitions), std::end(partitions), [&]() {
+        auto p = std::make_unique<Partition>();
+        if (predicor_params.admission_count > 1)
+            p->admission = std::make_unique<FrequencySketch>(rows);
+        if (predicor_params.algo & PredictorAlgoLookAhead)
+            p->streams = std::make_unique<StreamDetector>(predicor_params);
+        return p;
+    });
+
     if (!predicor_params.thread_count) {
         LOG(WARNING) << "Forcing single threaded version (threads' count N=" << predicor_params.thread_count << ")";
-        requests[0].reset(new RecordTable(predicor_params.record_table_num_rows, predicor_params.mining_table_num_rows));
-        r_requests = m_requests = requests[0].get();
+        std::for_each(std::begin(partitions), std::end(partitions), [&](auto& p) {
+            p->requests[0] = record_table();
+            p->r_requests = p->m_requests = p->requests[0].get();
+        });
     } else {
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
-        if (predicor_params.thread_count > 1) {
-            LOG(WARNING) << "Ignore requested threads' count N=" << predicor_params.thread_count << ". Only 1 worker thread is supported for now.";
-            predicor_params.thread_count = 1;
+        //'mine' thread handles the first part of mining table, persistent workers handle others (see 'worker')
+        for (size_t i = 1; i < predicor_params.thread_count; ++i) {
+            auto rows = (mining_rows(predicor_params) + predicor_params.thread_count - 1) / predicor_params.thread_count;
+            w_predictions.emplace_back(new PrefetchTable(rows, predicor_params.pf_list_size, predicor_params.is_priority_queue));
         }
 
         //TODO: maybe devide 'record_table_num_rows' by 2? otherwise we use x2 memory
-        requests[0].reset(new RecordTable(predicor_params.record_table_num_rows, predicor_params.mining_table_num_rows));
-        requests[1].reset(new RecordTable(predicor_params.record_table_num_rows, predicor_params.mining_table_num_rows));
-        r_requests = requests[0].get();
-        m_requests = requests[1].get();
-
-        thread = std::thread(std::bind(&DBSP::mine, this));
+        std::for_each(std::begin(partitions), std::end(partitions), [&](auto& p) {
+            p->requests[0] = record_table();
+            p->requests[1] = record_table();
+            p->r_requests = p->requests[0].get();
+            p->m_requests = p->requests[1].get();
+        });
 #else
         std::cerr << "FATAL ERROR: threading is not available\n";
         std::terminate();
 #endif
     }
 
-    q_predictions.reset(new PrefetchTable(predicor_params.prefetch_table_num_rows, predicor_params.pf_list_size));
-    m_predictions.reset(new PrefetchTable(predicor_params.mining_table_num_rows, predicor_params.pf_list_size));
+    if (predicor_params.prediction_eviction == PredictionEvictionClock)
+        clock.reset(new Clock(predicor_params.prefetch_table_num_rows, mining_rows(predicor_params)));
+    else
+        clock.reset();
+
+    auto q_table = [&]() {
+        return std::make_unique<PrefetchTable>(predicor_params.prefetch_table_num_rows, predicor_params.pf_list_size, predicor_params.is_priority_queue, clock.get(),
+                                               predicor_params.overlap_block_size);
+    };
+    q_predictions.Reset(q_table(), q_table());
+    m_predictions.reset(new PrefetchTable(mining_rows(predicor_params), predicor_params.pf_list_size, predicor_params.is_priority_queue));
+    window.reset(new MiningWindow(mining_rows(predicor_params)));
+
+    feedback.clear();
+    feedback.reserve(feedback_size(predicor_params));
+    applied.clear();
+    applied.reserve(feedback_size(predicor_params));
+
+    recorded = 0;
+    filled = false;
+    last_key = SIZE_MAX;
+    if (!predicor_params.snapshot_path.empty())
+        load(predicor_params.snapshot_path);
+
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    w_exit = false;
+    for (size_t i = 1; i <= w_predictions.size(); ++i)
+        workers.emplace_back(&DBSP::worker, this, i);
+    if (predicor_params.thread_count)
+        thread = std::thread(std::bind(&DBSP::mine, this));
+#endif
     return 0;
 }
 
+int DBSP::save(std::string const& path, bool with_records) {
+    snapshot::Header h = {};
+    std::copy(std::begin(snapshot::magic), std::end(snapshot::magic), h.magic);
+    h.version = snapshot::version;
+    h.header_size = sizeof(snapshot::Header);
+    h.ts = ts.load(std::memory_order_relaxed);
+    h.ts_type = predicor_params.ts_type;
+    h.pf_list_size = predicor_params.pf_list_size;
+    h.prediction_size = snapshot::PredictionSize(h.pf_list_size);
+    h.max_stamps = predicor_params.max_support + 1;
+    h.record_size = snapshot::RecordSize(h.max_stamps);
+
+    //entries are serialized in memory under the locks and written to the file after them,
+    //so neither publication nor producers wait for the disk
+    std::vector<char> predictions;
+    q_predictions.Read([&](PrefetchTable const& t) {
+        predictions.reserve(t.Size() * h.prediction_size);
+        t.ForEach([&](Prediction const& p) {
+            predictions.resize(predictions.size() + h.prediction_size);
+            auto e = reinterpret_cast<snapshot::Prediction*>(std::data(predictions) + predictions.size() - h.prediction_size);
+            auto a = reinterpret_cast<snapshot::Association*>(e + 1);
+            e->start_addr = p.start_addr_;
+            e->size_bytes = p.size_bytes_;
+            t.ForEach(p, [&](PrefetchedRequest const& x) {
+                a[e->count++] = snapshot::Association{ x.start_addr_, x.size_bytes_, x.distance, x.value };
+            });
+
+            ++h.predictions;
+        });
+    });
+
+    std::vector<char> records;
+    if (with_records) {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+        std::shared_lock m_lock(m_mutex);
+#endif
+        for (auto& p : partitions) {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+            std::unique_lock c_lock(p->mutex);
+#endif
+            p->r_requests->ForEach([&](Record const& r) {
+                records.resize(records.size() + h.record_size);
+                auto e = reinterpret_cast<snapshot::Record*>(std::data(records) + records.size() - h.record_size);
+                auto stamps = reinterpret_cast<int64_t*>(e + 1);
+                e->start_addr = r.start_addr_;
+                e->size_bytes = r.size_bytes_;
+                e->count = std::min<size_t>(r.Count(), h.max_stamps);
+                for (size_t i = 0; i < e->count; ++i)
+                    stamps[i] = r.Stamp(i);
+
+                ++h.records;
+            });
+        }
+    }
+
+    //written aside and renamed, so 'path' is either the previous snapshot or the complete new one
+    auto tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<char const*>(&h), sizeof(h));
+    out.write(std::data(predictions), predictions.size());
+    out.write(std::data(records), records.size());
+    out.close();
+
+    if (!out || std::rename(tmp.c_str(), path.c_str())) {
+        LOG(ERROR) << "Failed to save snapshot to \'" << path << "\'";
+        std::remove(tmp.c_str());
+        return -1;
+    }
+
+    LOG(INFO) << "Saved snapshot to \'" << path << "\': predictions " << h.predictions << ", records " << h.records;
+    return 0;
+}
+
+void DBSP::load(std::string const& path) {
+    snapshot::MappedFile file(path);
+    auto h = snapshot::Validate(file);
+    if (!h) {
+        LOG(WARNING) << "No valid snapshot at \'" << path << "\', starting from scratch";
+        return;
+    }
+
+    auto predictions = file.Data() + h->header_size;
+    std::vector<PrefetchedRequest> associations;
+    associations.reserve(h->pf_list_size);
+    if (clock)
+        clock->Record();
+    q_predictions.Write([&](PrefetchTable& t) {
+        auto p = predictions;
+        for (uint64_t i = 0; i < h->predictions; ++i, p += h->prediction_size) {
+            auto e = reinterpret_cast<snapshot::Prediction const*>(p);
+            auto a = reinterpret_cast<snapshot::Association const*>(e + 1);
+
+            associations.clear();
+            std::transform(a, a + std::min(e->count, h->pf_list_size), std::back_inserter(associations), [](auto const& x) {
+                return PrefetchedRequest{ Request{ x.start_addr, x.size_bytes }, x.value, x.distance };
+            });
+            t.Append(Request{ e->start_addr, e->size_bytes }, std::begin(associations), std::end(associations));
+        }
+        if (clock)
+            clock->Replay();
+    });
+
+    //stamps of another type or clock are meaningless
+    if (h->ts_type == uint32_t(predicor_params.ts_type)) {
+        auto r = predictions + h->predictions * h->prediction_size;
+        for (uint64_t i = 0; i < h->records; ++i, r += h->record_size) {
+            auto e = reinterpret_cast<snapshot::Record const*>(r);
+            auto stamps = reinterpret_cast<int64_t const*>(e + 1);
+            Request request{ e->start_addr, e->size_bytes };
+            PartitionOf(request).r_requests->Restore(request, stamps, std::min(e->count, h->max_stamps), predicor_params);
+        }
+
+        std::for_each(std::begin(partitions), std::end(partitions), [&](auto& p) {
+            recorded += p->r_requests->Available();
+            filled = filled || p->r_requests->Full();
+        });
+
+        if (TimeStamp::DoubleCounter == predicor_params.ts_type)
+            ts = h->ts;
+    } else if (h->records)
+        LOG(WARNING) << "Skip snapshot records of another time stamp type";
+
+    LOG(INFO) << "Loaded snapshot \'" << path << "\': predictions " << h->predictions << ", records " << h->records;
+}
+
 DBSP::~DBSP() {
     LOG(INFO) << "Destructing";
 
@@ -381,6 +1429,17 @@ DBSP::~DBSP() {
     if (thread.joinable()) {
         thread.join();
     }
+
+    //after 'mine' thread, so no round waits for them
+    {
+        std::unique_lock lock(w_mutex);
+        w_exit = true;
+        w_round.notify_all();
+    }
+
+    std::for_each(std::begin(workers), std::end(workers), [](auto& t) {
+        t.join();
+    });
 #endif
 }
 
@@ -396,52 +1455,124 @@ std::shared_ptr<IPredictorLink> DBSP::registerLink(void* owner, std::function<Pr
     std::unique_lock lock(n_mutex);
 #endif
     if (n)
-        callbacks.emplace(owner, n);
+        subscribers.emplace(owner, std::make_shared<Subscriber>(n, predicor_params));
     else
-        callbacks.erase(owner);
+        subscribers.erase(owner);
 
     return shared_from_this();
 }
 
-int DBSP::compute(Request req, size_t) {
-    ts++;
-    record(req);
+int DBSP::compute(Request req, size_t timestamp) {
+    record(&req, 1, timestamp);
+
+    return 0;
+}
+
+int DBSP::computeBatch(Request const* reqs, size_t count, size_t timestamp) {
+    record(reqs, count, timestamp);
 
     return 0;
 }
 
 std::optional<Request> DBSP::getAssociatedRequest(Request req, double association_priority) {
-    auto r = getAssociatedVectorOfRequests(req, association_priority);
-    return r.empty() ? std::nullopt : std::make_optional(*r.begin());
+    Request r;
+    return getAssociatedRequests(req, &r, 1, association_priority, nullptr) ? std::make_optional(r) : std::nullopt;
 }
 
-std::vector<Request> DBSP::getAssociatedVectorOfRequests(Request request, double /*association_priority*/) {
-    std::vector<Request> r;
-    r.reserve(predicor_params.pf_list_size);
+std::vector<Request> DBSP::getAssociatedVectorOfRequests(Request request, double association_priority) {
+    std::vector<Request> r(getAssociationsLimit());
+    r.resize(getAssociatedRequests(request, std::data(r), std::size(r), association_priority, nullptr));
+    return r;
+}
 
-#ifdef PREFETCH_ENABLE_MULTI_THREADED
-    std::shared_lock lock(m_mutex);
-#endif
+/* Associations of 'request' followed, up to 'dfs' depth, by associations of the previous depth ones (breadth first),
+   so chains are prefetched at once. Repeated requests (cycles) are skipped, 'getAssociationsLimit' bounds the fan-out.
+   Distances (if not null) of a chain add up, ones of streams are unknown */
+size_t DBSP::collect(PrefetchTable const& t, Request const& r, Request* out, size_t* distances, size_t capacity) const {
+    capacity = std::min(capacity, getAssociationsLimit());
+    auto request = normalize(r);
+
+    //predictions of a stream go first
+    size_t n = 0;
+    if (auto& streams = StreamsOf(request).streams)
+        n = streams->Predict(request, out, capacity);
+    if (distances)
+        std::fill_n(distances, n, 0);
+
+    auto add = [&](PrefetchedRequest const& a) {
+        if (n == capacity || a.start_addr_ == request.start_addr_ || std::any_of(out, out + n, [&](auto const& x) {
+                return x.start_addr_ == a.start_addr_;
+            }))
+            return;
+
+        if (distances)
+            distances[n] = a.distance;
+        out[n++] = a;
+    };
 
-    auto p = q_predictions->Find(request);
-    if (p)
-        std::copy_if(std::begin(p->associations.table), std::end(p->associations.table), std::back_inserter(r), [](auto r) {
-            return Valid(r);
-        });
+    auto begin = n;
+    t.Lookup(request, [&](Prediction const& p) {
+        t.Touch(&p);
+        t.ForEach(p, add);
+    });
+    for (size_t depth = 1, end = n; depth < predicor_params.dfs && begin != end; ++depth, begin = std::exchange(end, n))
+        for (size_t i = begin; i != end && n < capacity; ++i) {
+            auto distance = distances ? distances[i] : 0;
+            t.Lookup(out[i], [&](Prediction const& q) {
+                t.ForEach(q, [&](PrefetchedRequest a) {
+                    a.distance += distance;
+                    add(a);
+                });
+            });
+        }
+
+    return n;
+}
+
+size_t DBSP::getAssociatedRequests(Request request, Request* out, size_t capacity, double /*association_priority*/, size_t* distances) {
+    auto n = q_predictions.Read([&](PrefetchTable const& t) {
+        return collect(t, request, out, distances, capacity);
+    });
 
-    if (VLOG_IS_ON(2) && !r.empty()) {
+    if (VLOG_IS_ON(2) && n) {
         VLOG(2) << "Querying associations " << FORMAT_REQUEST((&request));
-        for (size_t i = 0; i < r.size(); ++i) {
-            VLOG(2) << "#" << std::setw(predicor_params.pf_list_size) << i << ": " << FORMAT_REQUEST((&r[i])) << " ";
+        for (size_t i = 0; i < n; ++i) {
+            VLOG(2) << "#" << std::setw(getAssociationsLimit()) << i << ": " << FORMAT_REQUEST((&out[i])) << " ";
         };
     } else if (VLOG_IS_ON(3))
         VLOG(3) << "Querying associations " << FORMAT_REQUEST((&request));
 
-    return r;
+    return n;
+}
+
+size_t DBSP::getAssociationsLimit() const {
+    auto streams = partitions.empty() ? nullptr : partitions.front()->streams.get();
+    return predicor_params.pf_list_size * std::max<size_t>(1, predicor_params.dfs) + (streams ? streams->Depth() : 0);
+}
+
+size_t DBSP::getAssociationsBatch(Request const* reqs, size_t count, Request* out, size_t out_capacity, size_t* counts, size_t* distances) {
+    return q_predictions.Read([&](PrefetchTable const& t) {
+        for (size_t i = 0; i < std::min(count, prefetch_distance); ++i)
+            t.Prefetch(normalize(reqs[i]));
+
+        size_t n = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (i + prefetch_distance < count)
+                t.Prefetch(normalize(reqs[i + prefetch_distance]));
+
+            counts[i] = collect(t, reqs[i], out + n, distances ? distances + n : nullptr, out_capacity - n);
+            n += counts[i];
+
+            VLOG(3) << "Querying associations " << FORMAT_REQUEST((&reqs[i])) << " => " << counts[i];
+        }
+
+        return n;
+    });
 }
 
 bool DBSP::CheckAvailable() const {
-    return r_requests->Available() >= predicor_params.mining_table_num_rows;
+    auto step = predicor_params.mining_step ? predicor_params.mining_step : predicor_params.mining_table_num_rows;
+    return filled.load(std::memory_order_relaxed) || recorded.load(std::memory_order_relaxed) >= step;
 }
 
 void DBSP::mine() {
@@ -449,8 +1580,9 @@ void DBSP::mine() {
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
         std::unique_lock lock(m_mutex);
 
+        //'CheckAvailable' w/ 'mining_step' doesn't depend on the cleared 'mining_table_num_rows'
         available.wait(lock, [&]() {
-            return CheckAvailable();
+            return !predicor_params.mining_table_num_rows || CheckAvailable();
         });
 #endif
 
@@ -458,62 +1590,303 @@ void DBSP::mine() {
             //exiting thread
             break;
 
-        std::swap(r_requests, m_requests);
+        std::for_each(std::begin(partitions), std::end(partitions), [](auto& p) {
+            std::swap(p->r_requests, p->m_requests);
+        });
+        recorded = 0;
+        filled = false;
 
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
+        ++swaps;
+        swapped.notify_all();
         lock.unlock();
 #endif
         do_mining();
         notify();
-#ifdef PREFETCH_ENABLE_MULTI_THREADED
-        lock.lock();
-#endif
-
-        q_predictions->Merge(std::move(*m_predictions));
+        publish();
     }
 }
 
-void DBSP::record(Request req) {
+//Requests which aren't recorded (e.g. streamed ones) don't move it
+uint64_t DBSP::get_time_stamp() const {
+    return ts.load(std::memory_order_relaxed);
+}
+
+uint64_t DBSP::Stamp(Request const& req, size_t timestamp) {
+    if (TimeStamp::DoubleTime != predicor_params.ts_type)
+        return ++ts;
+
+    //caller's time, request's time or the time since construction in microseconds
+    uint64_t t = timestamp ? timestamp : req.time_;
+    if (!t)
+        t = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+
+    ts.store(t, std::memory_order_relaxed);
+    return t;
+}
+
+void DBSP::record(Request const* reqs, size_t count, size_t timestamp) {
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
-    std::unique_lock c_lock(c_mutex);
     std::shared_lock m_lock(m_mutex);
 #endif
 
-    r_requests->Insert(req, ts.load(std::memory_order_relaxed), predicor_params);
+    auto hint = [&](Request const& r) {
+        auto k = normalize(r);
+        PartitionOf(k).r_requests->Prefetch(k);
+    };
+
+    //index and recording table of a partition are stable under 'm_mutex', so probing them needs no partition's lock
+    for (size_t i = 0; i < std::min(count, prefetch_distance); ++i)
+        hint(reqs[i]);
 
-    if (CheckAvailable()) {
+    for (size_t i = 0; i < count; ++i) {
+        if (i + prefetch_distance < count)
+            hint(reqs[i + prefetch_distance]);
+
+        auto r = normalize(reqs[i]);
+        //w/ counter stamps a request within the block of the previous one (of any partition) is the same reference
+        if (predicor_params.key_granularity > 1 && TimeStamp::DoubleTime != predicor_params.ts_type &&
+            last_key.exchange(r.start_addr_, std::memory_order_relaxed) == r.start_addr_)
+            continue;
+
+        //strided requests are predicted by streams, so they aren't mined
+        if (partitions.front()->streams && streamed(r))
+            continue;
+
+        auto& p = PartitionOf(r);
+        {
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
-        if (predicor_params.thread_count) {
-            VLOG(3) << "Notify available (N=" << r_requests->Available() << ")";
-            available.notify_one();
-        } else
-#else
-        assert(0 == predicor_params.thread_count);
+            std::unique_lock c_lock(p.mutex);
 #endif
-        {
+            auto before = p.r_requests->Available();
+            auto stamp = Stamp(r, timestamp);
+            if (p.Admit(r, predicor_params.admission_count) && !p.r_requests->Insert(r, stamp, predicor_params) && p.admission)
+                p.admission->Mark(r.start_addr_);
+
+            //the mining table may shrink too (by too frequent requests), while rows retained by the previous round
+            //aren't counted in 'recorded', so it doesn't go below zero
+            auto after = p.r_requests->Available();
+            if (after >= before)
+                recorded.fetch_add(after - before, std::memory_order_relaxed);
+            else {
+                auto n = recorded.load(std::memory_order_relaxed);
+                while (!recorded.compare_exchange_weak(n, n - std::min(n, before - after), std::memory_order_relaxed)) {
+                }
+            }
+            if (p.r_requests->Full())
+                filled.store(true, std::memory_order_relaxed);
+        }
+
+        if (CheckAvailable()) {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+            if (predicor_params.thread_count) {
+                VLOG(3) << "Notify available (N=" << recorded << ")";
+                available.notify_one();
+
+                //the rest of the batch would overflow a full mining table (its oldest rows are dropped),
+                //so 'm_lock' is released till the round takes the tables
+                if (filled.load(std::memory_order_relaxed))
+                    swapped.wait(m_lock, [&, round = swaps]() {
+                        return swaps != round;
+                    });
+            } else {
+                //other producers are waited out, so the tables are mined in place
+                m_lock.unlock();
+                std::unique_lock lock(m_mutex);
+                if (CheckAvailable()) {
+                    recorded = 0;
+                    filled = false;
+                    do_mining();
+                    notify();
+                    publish();
+                }
+                lock.unlock();
+                m_lock.lock();
+            }
+#else
+            assert(0 == predicor_params.thread_count);
+            recorded = 0;
+            filled = false;
             do_mining();
             notify();
-            q_predictions->Merge(std::move(*m_predictions));
+            publish();
+#endif
         }
     }
 }
 
+//Mines the range of worker 'w' among 'mine' thread (the first one) and additional workers
+void DBSP::work(size_t w, size_t mined) {
+    auto [r, e] = MiningWindow::Range(w, w_predictions.size() + 1, mined);
+    auto& t = w ? w_predictions[w - 1] : m_predictions;
+    window->Process(predicor_params, r, e, [&](auto& record, auto& a) {
+        t->Append(record, a.begin(), a.end());
+    });
+}
+
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+//Additional mining worker, it lives from 'init' till destruction and mines its range in each round
+void DBSP::worker(size_t w) {
+    size_t round = 0;
+    std::unique_lock lock(w_mutex);
+    while (true) {
+        w_round.wait(lock, [&]() {
+            return w_exit || round != w_rounds;
+        });
+
+        if (w_exit)
+            break;
+
+        round = w_rounds;
+        auto mined = w_mined;
+        lock.unlock();
+        work(w, mined);
+        lock.lock();
+
+        if (!--w_pending)
+            w_done.notify_one();
+    }
+}
+#endif
+
 void DBSP::do_mining() {
-    LOG_IF(ERROR, !m_requests->Available()) << "No request available for mining";
+    window->Clear();
+    std::for_each(std::begin(partitions), std::end(partitions), [&](auto& p) {
+        p->m_requests->Detach(*window);
+    });
+
+    LOG_IF(ERROR, !window->Size()) << "No request available for mining";
+    window->Sort();
+
+    auto size = window->Size();
+    auto mined = size;
+    if (auto step = predicor_params.mining_step) {
+        //a full table is mined anyway to free some room
+        mined = std::min(step, window->Closed(ts.load(std::memory_order_relaxed), predicor_params.lookahead_range));
+        if (!mined && std::any_of(std::begin(partitions), std::end(partitions), [](auto& p) {
+                return p->m_requests->Full();
+            }))
+            mined = std::min(step, size);
+    }
+
+    VLOG(1) << "Mining MT{" << mined << "/" << size << "} PT{" << m_predictions->Size() << "}";
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    if (!workers.empty()) {
+        std::unique_lock lock(w_mutex);
+        w_mined = mined;
+        w_pending = workers.size();
+        ++w_rounds;
+        w_round.notify_all();
+    }
+#endif
+    work(0, mined);
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    if (!workers.empty()) {
+        std::unique_lock lock(w_mutex);
+        w_done.wait(lock, [&]() {
+            return !w_pending;
+        });
+    }
+#endif
 
-    VLOG(1) << "Mining RT{" << m_requests->Size() << "} MT{" << m_requests->Available() << "} PT{" << m_predictions->Size() << "}";
-    m_requests->Process(predicor_params, [&](auto& r, auto& a) {
-        m_predictions->Append(r, a.begin(), a.end());
+    if (mined == size)
+        std::for_each(std::begin(partitions), std::end(partitions), [](auto& p) {
+            p->m_requests->Reset();
+        });
+    else {
+        window->Drop(mined);
+        std::for_each(std::begin(partitions), std::end(partitions), [](auto& p) {
+            p->m_requests->Retain();
+        });
+    }
+
+    //keep the order of single threaded mining
+    std::for_each(std::begin(w_predictions), std::end(w_predictions), [&](auto& t) {
+        m_predictions->Append(std::move(*t));
+    });
+}
+
+//The only writer of querying predictions: 'mine' thread or 'compute' caller under exclusive 'm_mutex'
+void DBSP::publish() {
+    {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+        std::unique_lock lock(f_mutex);
+#endif
+        feedback.swap(applied);
+    }
+
+    VLOG_IF(1, !applied.empty()) << "Applying feedback N=" << applied.size();
+    if (clock)
+        clock->Record();
+    q_predictions.Write([&](PrefetchTable& t) {
+        t.Apply(applied);
+        t.Merge(*m_predictions);
+        if (clock)
+            clock->Replay();  //the same victims on the other instance
     });
+    applied.clear();
+    m_predictions->Clear();
+}
+
+void DBSP::reportUseful(Request src, Request assoc) {
+    report(src, assoc, true);
+}
+
+void DBSP::reportWasted(Request src, Request assoc) {
+    if (partitions.front()->streams) {
+        auto r = normalize(src);
+        auto& p = StreamsOf(r);
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+        std::unique_lock lock(p.mutex);
+#endif
+        p.streams->Wasted(r, assoc);
+    }
+
+    report(src, assoc, false);
+}
+
+bool DBSP::streamed(Request const& r) {
+    auto& p = StreamsOf(r);
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    std::unique_lock lock(p.mutex);
+#endif
+    return p.streams->Update(r);
+}
+
+//Cache's threads: feedback is queued to be applied by the next publication
+void DBSP::report(Request const& src, Request const& assoc, bool useful) {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    std::unique_lock lock(f_mutex);
+#endif
+    if (feedback.size() < feedback_size(predicor_params))
+        feedback.push_back(Feedback{ normalize(src).start_addr_, assoc.start_addr_, useful });
+}
+
+//Requests are keyed by blocks of 'key_granularity' bytes, so ones of the same block at different offsets are the same
+Request DBSP::normalize(Request r) const {
+    auto g = predicor_params.key_granularity;
+    if (g < 2)
+        return r;
+
+    auto end = r.start_addr_ + std::max<size_t>(1, r.size_bytes_);
+    r.start_addr_ -= r.start_addr_ % g;
+    r.size_bytes_ = (end + g - 1) / g * g - r.start_addr_;
+    return r;
 }
 
 void DBSP::notify() {
 #ifdef PREFETCH_ENABLE_MULTI_THREADED
     std::unique_lock lock(n_mutex);
 #endif
+    if (subscribers.empty())
+        return;
+
+    std::for_each(std::begin(subscribers), std::end(subscribers), [](auto& s) {
+        s.second->Flush();
+    });
 
     m_predictions->Notify(predicor_params, [&](Request r, Request const* associations, size_t size) {
-        std::for_each(std::begin(callbacks), std::end(callbacks), [&](auto& c) {
+        std::for_each(std::begin(subscribers), std::end(subscribers), [&](auto& c) {
             if (VLOG_IS_ON(3)) {
                 VLOG(3) << "Notify " << std::hex << c.first << " for request " << FORMAT_REQUEST((&r));
                 for (size_t i = 0; i < size; ++i) {
@@ -521,7 +1894,26 @@ void DBSP::notify() {
                 };
             }
 
-            c.second(r, associations, size);
+            c.second->Offer(r, associations, size);
         });
     });
+
+    //publish the batch
+    std::for_each(std::begin(subscribers), std::end(subscribers), [](auto& s) {
+        s.second->Commit();
+    });
+}
+
+size_t DBSP::drainNotifications(void* owner, size_t limit) {
+    std::shared_ptr<Subscriber> s;
+    {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+        std::unique_lock lock(n_mutex);
+#endif
+        auto i = subscribers.find(owner);
+        if (i != std::end(subscribers))
+            s = i->second;
+    }
+
+    return s ? s->Drain(limit) : 0;
 }
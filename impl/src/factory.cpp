@@ -4,6 +4,8 @@
 #include "cache.h"
 #include "lru.h"
 #include "dbsp.h"
+#include "lookahead.h"
+#include "mithril.h"
 
 std::unique_ptr<ICache> CreateCache(CacheType t, PrefetchPolicy p) {
     if (t == CacheType::LRU) {
@@ -27,6 +29,12 @@ std::shared_ptr<IPredictor> IPredictor::create(PredictorType t, const PredictorP
     switch (t) {
     case PredictorType::DBSP:
         return std::make_shared<DBSP>(par);
+    case PredictorType::PartitionedDBSP:
+        return std::make_shared<DBSP>(par, true);
+    case PredictorType::LookAhead:
+        return std::make_shared<LookAhead>(par);
+    case PredictorType::Mithril:
+        return std::make_shared<Mithril>(par);
     default:
         assert(!"Unknown predictor type");
         return std::shared_ptr<IPredictor>(nullptr);
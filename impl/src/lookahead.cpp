@@ -0,0 +1,233 @@
+#include "lookahead.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+constexpr size_t default_stream_count = 16;
+constexpr size_t default_stream_depth = 8;
+
+size_t stream_count(PredictorParams const& p) {
+    return p.stream_count ? p.stream_count : default_stream_count;
+}
+
+size_t stream_depth(PredictorParams const& p) {
+    return p.stream_depth ? p.stream_depth : default_stream_depth;
+}
+}  // namespace
+
+StreamDetector::StreamDetector(PredictorParams const& p)
+    : streams(stream_count(p)),
+      published(std::make_unique<Published[]>(stream_count(p))),
+      max_depth(stream_depth(p)) {}
+
+size_t StreamDetector::Footprint(PredictorParams const& p) {
+    return sizeof(StreamDetector) + stream_count(p) * (sizeof(Stream) + sizeof(Published));
+}
+
+void StreamDetector::Publish(Stream const& s) {
+    auto& p = published[&s - std::data(streams)];
+    auto seq = p.seq.load(std::memory_order_relaxed);
+    p.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    p.last.store(s.last, std::memory_order_relaxed);
+    p.size.store(s.size, std::memory_order_relaxed);
+    p.stride.store(s.stride, std::memory_order_relaxed);
+    p.depth.store(s.hits >= min_hits ? s.depth : 0, std::memory_order_relaxed);
+    p.seq.store(seq + 2, std::memory_order_release);
+}
+
+StreamDetector::Stream* StreamDetector::Victim() {
+    return &*std::min_element(std::begin(streams), std::end(streams), [](auto const& l, auto const& r) {
+        return l.used < r.used;
+    });
+}
+
+bool StreamDetector::Update(Request const& r) {
+    ++tick;
+
+    //the closest unconfirmed stream is trained by 'r' unless 'r' continues a stream
+    Stream* near = nullptr;
+    int64_t near_distance = 0;
+    for (auto& s : streams) {
+        if (!s.used)
+            continue;
+
+        auto delta = int64_t(r.start_addr_) - int64_t(s.last);
+        if (s.stride && delta == s.stride) {
+            s.last = r.start_addr_;
+            s.size = r.size_bytes_;
+            s.used = tick;
+            if (++s.hits >= min_hits)
+                s.depth = uint32_t(std::min<size_t>(max_depth, s.depth ? 2 * s.depth : 1));
+
+            Publish(s);
+            VLOG(3) << "Stream " << FORMAT_REQUEST((&r)) << " stride " << s.stride << " depth " << s.depth;
+            return s.hits >= min_hits;
+        }
+
+        //repeated request doesn't break the stream
+        if (!delta) {
+            s.used = tick;
+            return false;
+        }
+
+        auto distance = std::abs(delta);
+        if (s.hits < min_hits && distance <= max_stride * int64_t(std::max(r.size_bytes_, s.size)) && (!near || distance < near_distance)) {
+            near = &s;
+            near_distance = distance;
+        }
+    }
+
+    if (near) {
+        near->stride = int64_t(r.start_addr_) - int64_t(near->last);
+        near->hits = 1;
+    } else {
+        near = Victim();
+        *near = Stream{};
+    }
+
+    near->depth = 0;
+    near->last = r.start_addr_;
+    near->size = r.size_bytes_;
+    near->used = tick;
+    Publish(*near);
+    return false;
+}
+
+size_t StreamDetector::Predict(Request const& r, Request* out, size_t capacity) const {
+    for (size_t i = 0; i < std::size(streams); ++i) {
+        auto& p = published[i];
+        if (p.last.load(std::memory_order_relaxed) != r.start_addr_)
+            continue;
+
+        //a stream updated meanwhile is read again
+        size_t last, size;
+        int64_t stride;
+        uint32_t depth, seq;
+        do {
+            seq = p.seq.load(std::memory_order_acquire);
+            last = p.last.load(std::memory_order_relaxed);
+            size = p.size.load(std::memory_order_relaxed);
+            stride = p.stride.load(std::memory_order_relaxed);
+            depth = p.depth.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != p.seq.load(std::memory_order_relaxed));
+
+        if (!depth || last != r.start_addr_)
+            continue;
+
+        size_t n = 0;
+        auto count = std::min<size_t>(depth, capacity);
+        for (auto addr = int64_t(r.start_addr_) + stride; n < count && addr >= 0; addr += stride)
+            out[n++] = Request{ size_t(addr), size, r.time_, r.op_ };
+
+        return n;
+    }
+
+    return 0;
+}
+
+void StreamDetector::Wasted(Request const& src, Request const& assoc) {
+    for (auto& s : streams) {
+        if (s.hits < min_hits || (int64_t(s.last) - int64_t(src.start_addr_)) % s.stride)
+            continue;
+
+        //'k'-th prediction of 'src' starts at 'src + k * stride', the division truncates toward zero
+        auto d = int64_t(assoc.start_addr_) - int64_t(src.start_addr_);
+        for (auto k = d / s.stride; k <= d / s.stride + 1; ++k) {
+            if (k < 1 || k > int64_t(max_depth) || d - k * s.stride < 0 || d - k * s.stride >= int64_t(s.size))
+                continue;
+
+            s.depth = std::max<uint32_t>(1, s.depth / 2);
+            Publish(s);
+            VLOG(2) << "Stream " << FORMAT_REQUEST((&src)) << " wastes, depth " << s.depth;
+            return;
+        }
+    }
+}
+
+struct LookAhead::Link : IPredictorLink {
+    StreamDetector streams;
+    std::function<PredictorNotify> callback;
+    std::vector<Request> predictions;  //of a notification
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    std::mutex mutex;  //updates guard, a link may be shared by threads
+#endif
+
+    Link(PredictorParams const& p, std::function<PredictorNotify> f) : streams(p), callback(std::move(f)), predictions(streams.Depth()) {}
+
+    //'callback' is invoked under the link's lock, so it shall not call the link back
+    int compute(Request req, size_t) override {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+        std::unique_lock lock(mutex);
+#endif
+        if (streams.Update(req) && callback)
+            callback(req, std::data(predictions), streams.Predict(req, std::data(predictions), std::size(predictions)));
+
+        return 0;
+    }
+
+    std::optional<Request> getAssociatedRequest(Request req, double association_priority) override {
+        Request r;
+        return getAssociatedRequests(req, &r, 1, association_priority, nullptr) ? std::make_optional(r) : std::nullopt;
+    }
+
+    std::vector<Request> getAssociatedVectorOfRequests(Request req, double association_priority) override {
+        std::vector<Request> r(streams.Depth());
+        r.resize(getAssociatedRequests(req, std::data(r), std::size(r), association_priority, nullptr));
+        return r;
+    }
+
+    //distances of streams are unknown
+    size_t getAssociatedRequests(Request req, Request* out, size_t capacity, double /*association_priority*/, size_t* distances) override {
+        auto n = streams.Predict(req, out, capacity);
+        if (distances)
+            std::fill_n(distances, n, 0);
+        return n;
+    }
+
+    size_t getAssociationsLimit() const override {
+        return streams.Depth();
+    }
+
+    void reportWasted(Request src, Request assoc) override {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+        std::unique_lock lock(mutex);
+#endif
+        streams.Wasted(src, assoc);
+    }
+};
+
+LookAhead::LookAhead(const PredictorParams& p) : predicor_params(p) {}
+
+int LookAhead::init(const PredictorParams& p) {
+    predicor_params = p;
+    LOG(INFO) << "Constructing w/ params:"
+              << "\n\tstreams {" << stream_count(p) << "}"
+              << "\n\tdepth {" << stream_depth(p) << "}"
+              << "\n\tfootprint per link {" << StreamDetector::Footprint(p) << "}";
+    return 0;
+}
+
+PredictorParams LookAhead::get_params(size_t bytes_total_size) {
+    PredictorParams par = predicor_params;
+    par.algo |= PredictorAlgoLookAhead;
+    par.stream_count = stream_count(par);
+    par.stream_depth = stream_depth(par);
+    par.pf_list_size = par.stream_depth;  //predictions per request
+
+    return StreamDetector::Footprint(par) <= bytes_total_size ? par : PredictorParams{};
+}
+
+std::shared_ptr<IPredictorLink> LookAhead::registerLink() {
+    LOG(INFO) << "New link is registered";
+    return std::make_shared<Link>(predicor_params, nullptr);
+}
+
+std::shared_ptr<IPredictorLink> LookAhead::registerLink(void* owner, std::function<PredictorNotify> n) {
+    LOG(INFO) << "New link(owner=" << std::hex << owner << ") is registered";
+    return std::make_shared<Link>(predicor_params, std::move(n));
+}
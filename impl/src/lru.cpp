@@ -4,10 +4,11 @@
 #include <cmath>
 #include <iostream>
 
-void LruCache::Init(const CacheParams& par) {
+void LruCache::Init(const CacheParams& par, Feedback feedback) {
     VerifyParams(par);
 
     _par = par;
+    _feedback = std::move(feedback);
 
     _cache = std::make_unique<lru_cache<size_t, page_w_blocks_t>>(_par.cache_size / _par.page_size);
 }
@@ -16,6 +17,29 @@ void LruCache::Verify(const Request& r) const {
     VerifyRequest(r, _par);
 }
 
+uint32_t LruCache::Evicted(size_t id, const page_w_blocks_t& page) const {
+    uint32_t num_evicted_untouched = 0;
+    for (auto& blk : page) {
+        if (std::get<IsFromPredictor>(blk.second).val == false || std::get<NumReads>(blk.second).val != 0)
+            continue;
+
+        ++num_evicted_untouched;
+        if (_feedback) {
+            auto& s = std::get<Source>(blk.second);
+            _feedback(Request{ s.start_addr, s.size_bytes }, Request{ id * _par.page_size + blk.first * _par.block_size, _par.block_size }, false);
+        }
+    }
+
+    return num_evicted_untouched;
+}
+
+void LruCache::Touched(size_t id, uint32_t blk, block_t& b) const {
+    if (std::get<NumReads>(b).val++ == 0 && std::get<IsFromPredictor>(b).val == true && _feedback) {
+        auto& s = std::get<Source>(b);
+        _feedback(Request{ s.start_addr, s.size_bytes }, Request{ id * _par.page_size + blk * _par.block_size, _par.block_size }, true);
+    }
+}
+
 Response LruCache::Write(const Request& r) {
     Verify(r);
 
@@ -25,15 +49,12 @@ Response LruCache::Write(const Request& r) {
         auto opt = _cache->get(page_it.id);
         auto [existed_page, evicted_page] = opt ? std::make_pair(opt.value(), std::nullopt) : _cache->put(page_it.id, {});
 
-        if (evicted_page) {
-            for (auto& blk : evicted_page.value().second) {
-                num_evicted_untouched += (std::get<IsFromPredictor>(blk.second).val == true) && (std::get<NumReads>(blk.second).val == 0);
-            }
-        }
+        if (evicted_page)
+            num_evicted_untouched += Evicted(evicted_page.value().first, evicted_page.value().second);
 
         for (auto x = 0; x < page_it.num_blocks; ++x) {
             if (auto block_it = existed_page.find(page_it.block_id + x); block_it == existed_page.end()) {
-                existed_page.insert({ page_it.block_id + x, std::make_tuple(IsFromPredictor{ false }, NumReads{ 0 }) });
+                existed_page.insert({ page_it.block_id + x, std::make_tuple(IsFromPredictor{ false }, NumReads{ 0 }, Source{}) });
             }
         }
     });
@@ -57,20 +78,16 @@ Response LruCache::Read(const Request& r) {
         auto opt = _cache->get(page_it.id);
         auto [existed_page, evicted_page] = opt ? std::make_pair(opt.value(), std::nullopt) : _cache->put(page_it.id, {});
 
-        if (evicted_page) {
-            for (auto& blk : evicted_page.value().second) {
-                num_evicted_untouched += (std::get<IsFromPredictor>(blk.second).val == true) && (std::get<NumReads>(blk.second).val == 0);
-            }
-        }
+        if (evicted_page)
+            num_evicted_untouched += Evicted(evicted_page.value().first, evicted_page.value().second);
 
         for (auto x = 0; x < page_it.num_blocks; ++x) {
             if (auto block_it = existed_page.find(page_it.block_id + x); block_it != existed_page.end()) {
                 ++num_cache_hits;
-                auto& blk = block_it->second;
-                ++std::get<NumReads>(blk).val;
+                Touched(page_it.id, block_it->first, block_it->second);
             } else {
                 ++num_cache_misses;
-                existed_page.insert({ page_it.block_id + x, std::make_tuple(IsFromPredictor{ false }, NumReads{ 0 }) });
+                existed_page.insert({ page_it.block_id + x, std::make_tuple(IsFromPredictor{ false }, NumReads{ 0 }, Source{}) });
             }
         }
     });
@@ -83,26 +100,23 @@ Response LruCache::Read(const Request& r) {
                            cache::InternalNumRequest{ 0 });
 }
 
-Response LruCache::Prefetch(const Request& r) {
+Response LruCache::Prefetch(const Request& r, const Request& source) {
     Verify(r);
 
     uint32_t num_prefetched = 0;
     uint32_t num_evicted_untouched = 0;
 
-    std::for_each(PageIterator(_par, r), PageIterator(_par), [this, &num_prefetched, &num_evicted_untouched](auto& page_it) {
+    std::for_each(PageIterator(_par, r), PageIterator(_par), [this, &source, &num_prefetched, &num_evicted_untouched](auto& page_it) {
         auto opt = _cache->get(page_it.id);
         auto [existed_page, evicted_page] = opt ? std::make_pair(opt.value(), std::nullopt) : _cache->put(page_it.id, {});
 
-        if (evicted_page) {
-            for (auto& blk : evicted_page.value().second) {
-                num_evicted_untouched += (std::get<IsFromPredictor>(blk.second).val == true) && (std::get<NumReads>(blk.second).val == 0);
-            }
-        }
+        if (evicted_page)
+            num_evicted_untouched += Evicted(evicted_page.value().first, evicted_page.value().second);
 
         for (auto x = 0; x < page_it.num_blocks; ++x) {
             if (auto block_it = existed_page.find(page_it.block_id + x) == existed_page.end()) {
                 ++num_prefetched;
-                existed_page.insert({ page_it.block_id + x, std::make_tuple(IsFromPredictor{ true }, NumReads{ 0 }) });
+                existed_page.insert({ page_it.block_id + x, std::make_tuple(IsFromPredictor{ true }, NumReads{ 0 }, Source{ source.start_addr_, source.size_bytes_ }) });
             }
         }
     });
@@ -0,0 +1,319 @@
+#include "mithril.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+
+namespace {
+constexpr uint32_t none = ~0u;
+
+//Node of 'std::unordered_map' w/ allocator's overhead and its bucket
+constexpr size_t hash_entry_size = sizeof(std::pair<size_t, uint32_t>) + 4 * sizeof(void*);
+
+size_t stamps_per_row(PredictorParams const& p) {
+    return std::max<size_t>(1, p.max_support);
+}
+
+size_t associations_per_row(PredictorParams const& p) {
+    return std::max<size_t>(1, p.pf_list_size);
+}
+}  // namespace
+
+Mithril::Mithril(const PredictorParams& p) : predicor_params(p) {}
+
+size_t Mithril::Footprint(PredictorParams const& p) {
+    auto record_table = [&](size_t rows) {
+        return rows * (sizeof(Row) + stamps_per_row(p) * sizeof(int64_t) + hash_entry_size);
+    };
+
+    size_t bytes = sizeof(Mithril);
+    bytes += record_table(p.record_table_num_rows);
+    bytes += record_table(p.mining_table_num_rows) + p.mining_table_num_rows * sizeof(uint32_t);
+    bytes += p.prefetch_table_num_rows * (sizeof(Row) + associations_per_row(p) * sizeof(Request) + sizeof(uint32_t) + hash_entry_size);
+    return bytes;
+}
+
+PredictorParams Mithril::get_params(size_t bytes_total_size) {
+    // Params of the paper, tables are sized as DBSP's ones
+    constexpr auto record_prefech_tables_ratio = 5. / 100;
+
+    PredictorParams par = predicor_params;
+    par.algo |= PredictorAlgoMithrill;
+    //a predictor created w/o params gets the default ones
+    if (!par.max_support) {
+        par.req_size_update_policy = RequestSizeUpdatePolicy::UpdateWithLargest;
+        par.min_support = 2;
+        par.max_support = 8;
+    }
+    if (!par.lookahead_range)
+        par.lookahead_range = 20;
+    if (!par.pf_list_size)
+        par.pf_list_size = 2;
+    if (!par.mining_table_num_rows)
+        par.mining_table_num_rows = 2560;
+
+    auto fit = [&](size_t prefetch_table_num_rows) {
+        par.prefetch_table_num_rows = prefetch_table_num_rows;
+        par.record_table_num_rows = prefetch_table_num_rows * record_prefech_tables_ratio;
+        return Footprint(par) <= bytes_total_size;
+    };
+
+    constexpr size_t min_prefetch_entries = 1000;
+    //rows are indexed by 32 bits
+    constexpr size_t max_prefetch_entries = size_t(1) << 28;
+
+    auto rows = LargestFitting(min_prefetch_entries, max_prefetch_entries, fit);
+    if (!rows)
+        return {};
+
+    fit(rows);
+    return par;
+}
+
+int Mithril::init(const PredictorParams& var) {
+    predicor_params = var;
+    max_stamps = stamps_per_row(var);
+    max_associations = associations_per_row(var);
+
+    LOG(INFO) << "Constructing w/ params:"
+              << "\n\tmin/max {" << var.min_support << "," << var.max_support << "}"
+              << "\n\tRT/MT/PT rows {" << var.record_table_num_rows << "," << var.mining_table_num_rows << "," << var.prefetch_table_num_rows << "}"
+              << "\n\tfootprint {" << Footprint(var) << "}";
+    LOG_IF(WARNING, var.thread_count) << "Ignore requested threads' count N=" << var.thread_count << ", mining is in the caller's thread";
+    LOG_IF(WARNING, TimeStamp::DoubleCounter != var.ts_type) << "Ignore time stamp type, stamps are reference numbers";
+
+    auto rows = [](size_t n) {
+        return std::max<size_t>(1, n);
+    };
+
+    r_rows.assign(rows(var.record_table_num_rows), Row{});
+    r_stamps.assign(r_rows.size() * max_stamps, 0);
+    r_next = 0;
+
+    m_rows.assign(rows(var.mining_table_num_rows), Row{});
+    m_stamps.assign(m_rows.size() * max_stamps, 0);
+    m_size = 0;
+    m_order.reserve(m_rows.size());
+
+    records.clear();
+    records.reserve(r_rows.size() + m_rows.size());
+
+    p_rows.assign(rows(var.prefetch_table_num_rows), Row{});
+    p_associations.assign(p_rows.size() * max_associations, Request{});
+    p_oldest.assign(p_rows.size(), 0);
+    p_next = 0;
+    predictions.clear();
+    predictions.reserve(p_rows.size());
+
+    ts = 0;
+    return 0;
+}
+
+std::shared_ptr<IPredictorLink> Mithril::registerLink() {
+    LOG(INFO) << "New link is registered";
+    return shared_from_this();
+}
+
+std::shared_ptr<IPredictorLink> Mithril::registerLink(void* owner, std::function<PredictorNotify> n) {
+    LOG(INFO) << "New link(owner=" << std::hex << owner << ") is registered";
+
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    std::unique_lock lock(mutex);
+#endif
+    if (n)
+        subscribers[owner] = std::move(n);
+    else
+        subscribers.erase(owner);
+
+    return shared_from_this();
+}
+
+int Mithril::compute(Request req, size_t /*timestamp*/) {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    std::unique_lock lock(mutex);
+#endif
+    record(req);
+    return 0;
+}
+
+std::optional<Request> Mithril::getAssociatedRequest(Request req, double association_priority) {
+    Request r;
+    return getAssociatedRequests(req, &r, 1, association_priority, nullptr) ? std::make_optional(r) : std::nullopt;
+}
+
+std::vector<Request> Mithril::getAssociatedVectorOfRequests(Request request, double association_priority) {
+    std::vector<Request> r(getAssociationsLimit());
+    r.resize(getAssociatedRequests(request, std::data(r), std::size(r), association_priority, nullptr));
+    return r;
+}
+
+//Distances aren't mined, so they are unknown
+size_t Mithril::getAssociatedRequests(Request request, Request* out, size_t capacity, double /*association_priority*/, size_t* distances) {
+#ifdef PREFETCH_ENABLE_MULTI_THREADED
+    std::unique_lock lock(mutex);
+#endif
+    auto i = predictions.find(request.start_addr_);
+    if (i == std::end(predictions))
+        return 0;
+
+    auto n = std::min<size_t>(p_rows[i->second].count, capacity);
+    std::copy_n(&p_associations[i->second * max_associations], n, out);
+    if (distances)
+        std::fill_n(distances, n, 0);
+    return n;
+}
+
+size_t Mithril::getAssociationsLimit() const {
+    return max_associations;
+}
+
+void Mithril::record(Request const& r) {
+    ++ts;
+
+    auto i = records.find(r.start_addr_);
+    if (i == std::end(records)) {
+        //new request takes the oldest row of the ring
+        auto& row = r_rows[r_next];
+        if (row.count)
+            records.erase(row.start_addr);
+
+        row = Row{ r.start_addr_, r.size_bytes_, 0 };
+        i = records.emplace(r.start_addr_, uint32_t(r_next)).first;
+        r_next = (r_next + 1) % r_rows.size();
+    }
+
+    auto index = i->second;
+    if (index & mining) {
+        auto m = index & ~mining;
+        auto& row = m_rows[m];
+        if (row.count == max_stamps) {
+            VLOG(2) << "Drop too frequent " << FORMAT_REQUEST((&r));
+            drop(m);
+            return;
+        }
+
+        row.size_bytes = std::max(row.size_bytes, r.size_bytes_);
+        m_stamps[m * max_stamps + row.count++] = ts;
+        return;
+    }
+
+    auto& row = r_rows[index];
+    if (row.count == max_stamps) {
+        records.erase(i);
+        row.count = 0;
+        return;
+    }
+
+    row.size_bytes = std::max(row.size_bytes, r.size_bytes_);
+    r_stamps[index * max_stamps + row.count++] = ts;
+    if (row.count < predicor_params.min_support)
+        return;
+
+    //moved to the mining table, the row of the ring is free
+    auto m = m_size++;
+    m_rows[m] = row;
+    std::copy_n(&r_stamps[index * max_stamps], row.count, &m_stamps[m * max_stamps]);
+    row.count = 0;
+    i->second = uint32_t(m) | mining;
+
+    if (m_size == m_rows.size())
+        mine();
+}
+
+//Drops row 'm' of the mining table, the last one takes its place
+void Mithril::drop(uint32_t m) {
+    records.erase(m_rows[m].start_addr);
+
+    auto last = uint32_t(--m_size);
+    if (m == last)
+        return;
+
+    m_rows[m] = m_rows[last];
+    std::copy_n(&m_stamps[last * max_stamps], m_rows[m].count, &m_stamps[m * max_stamps]);
+    records[m_rows[m].start_addr] = m | mining;
+}
+
+bool Mithril::associated(uint32_t a, uint32_t b) const {
+    auto& l = m_rows[a];
+    auto& r = m_rows[b];
+    if (size_t(std::abs(int64_t(l.count) - int64_t(r.count))) > predicor_params.confidence)
+        return false;
+
+    auto x = &m_stamps[a * max_stamps];
+    auto y = &m_stamps[b * max_stamps];
+    for (size_t i = 0, errors = 0; i < std::min(l.count, r.count); ++i)
+        if (size_t(std::abs(x[i] - y[i])) > predicor_params.lookahead_range && ++errors > predicor_params.confidence)
+            return false;
+
+    return true;
+}
+
+//Adds 'dst' to associations of 'src' (the oldest one is replaced if the list is full), returns the row of 'src'
+uint32_t Mithril::associate(Row const& src, Row const& dst) {
+    uint32_t p;
+    if (auto i = predictions.find(src.start_addr); i != std::end(predictions))
+        p = i->second;
+    else {
+        p = uint32_t(p_next);
+        auto& row = p_rows[p];
+        if (row.size_bytes)
+            predictions.erase(row.start_addr);
+
+        row = Row{ src.start_addr, src.size_bytes, 0 };
+        p_oldest[p] = 0;
+        predictions.emplace(src.start_addr, p);
+        p_next = (p_next + 1) % p_rows.size();
+    }
+
+    auto& row = p_rows[p];
+    auto a = &p_associations[p * max_associations];
+    if (std::any_of(a, a + row.count, [&](auto const& x) {
+            return x.start_addr_ == dst.start_addr;
+        }))
+        return p;
+
+    Request x{ dst.start_addr, dst.size_bytes };
+    if (row.count < max_associations)
+        a[row.count++] = x;
+    else {
+        a[p_oldest[p]] = x;
+        p_oldest[p] = uint32_t((p_oldest[p] + 1) % max_associations);
+    }
+
+    return p;
+}
+
+void Mithril::mine() {
+    auto first = [&](uint32_t m) {
+        return m_stamps[m * max_stamps];
+    };
+
+    m_order.resize(m_size);
+    std::iota(std::begin(m_order), std::end(m_order), 0);
+    std::stable_sort(std::begin(m_order), std::end(m_order), [&](auto l, auto r) {
+        return first(l) < first(r);
+    });
+
+    VLOG(1) << "Mining MT{" << m_size << "} PT{" << predictions.size() << "}";
+    for (size_t i = 0; i < m_size; ++i) {
+        auto src = m_order[i];
+        auto p = none;
+        for (size_t j = i + 1; j < m_size; ++j) {
+            auto dst = m_order[j];
+            if (size_t(first(dst) - first(src)) > predicor_params.lookahead_range)
+                break;
+
+            if (associated(src, dst))
+                p = associate(m_rows[src], m_rows[dst]);
+        }
+
+        if (p != none)
+            for (auto& s : subscribers)
+                s.second(Request{ p_rows[p].start_addr, p_rows[p].size_bytes }, &p_associations[p * max_associations], p_rows[p].count);
+    }
+
+    for (size_t m = 0; m < m_size; ++m)
+        records.erase(m_rows[m].start_addr);
+    m_size = 0;
+}
@@ -0,0 +1,129 @@
+#include "simd.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#    define SIMD_X86
+#    include <immintrin.h>
+#endif
+
+namespace simd {
+namespace {
+
+Deltas Scalar(int64_t const* a, int64_t const* b, size_t count, int64_t lookahead) {
+    Deltas d{ std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), 0 };
+    for (size_t i = 0; i < count; ++i) {
+        auto delta = std::abs(a[i] - b[i]);
+        d.errors += delta > lookahead;
+        d.min = std::min(d.min, delta);
+        d.max = std::max(d.max, delta);
+    }
+
+    return d;
+}
+
+#ifdef SIMD_X86
+__attribute__((target("avx2"))) Deltas Avx2(int64_t const* a, int64_t const* b, size_t count, int64_t lookahead) {
+    const auto zero = _mm256_setzero_si256();
+    const auto limit = _mm256_set1_epi64x(lookahead);
+    auto min = _mm256_set1_epi64x(std::numeric_limits<int64_t>::max());
+    auto max = _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+    auto errors = zero;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto delta = _mm256_sub_epi64(_mm256_loadu_si256((__m256i const*)(a + i)), _mm256_loadu_si256((__m256i const*)(b + i)));
+        auto negative = _mm256_cmpgt_epi64(zero, delta);
+        delta = _mm256_sub_epi64(_mm256_xor_si256(delta, negative), negative);
+
+        //comparison result is -1 for true
+        errors = _mm256_sub_epi64(errors, _mm256_cmpgt_epi64(delta, limit));
+        min = _mm256_blendv_epi8(min, delta, _mm256_cmpgt_epi64(min, delta));
+        max = _mm256_blendv_epi8(max, delta, _mm256_cmpgt_epi64(delta, max));
+    }
+
+    alignas(32) int64_t mins[4], maxs[4], errs[4];
+    _mm256_store_si256((__m256i*)mins, min);
+    _mm256_store_si256((__m256i*)maxs, max);
+    _mm256_store_si256((__m256i*)errs, errors);
+
+    auto d = Scalar(a + i, b + i, count - i, lookahead);
+    for (size_t l = 0; l < 4; ++l) {
+        d.min = std::min(d.min, mins[l]);
+        d.max = std::max(d.max, maxs[l]);
+        d.errors += errs[l];
+    }
+
+    return d;
+}
+
+__attribute__((target("sse4.2"))) Deltas Sse42(int64_t const* a, int64_t const* b, size_t count, int64_t lookahead) {
+    const auto zero = _mm_setzero_si128();
+    const auto limit = _mm_set1_epi64x(lookahead);
+    auto min = _mm_set1_epi64x(std::numeric_limits<int64_t>::max());
+    auto max = _mm_set1_epi64x(std::numeric_limits<int64_t>::min());
+    auto errors = zero;
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        auto delta = _mm_sub_epi64(_mm_loadu_si128((__m128i const*)(a + i)), _mm_loadu_si128((__m128i const*)(b + i)));
+        auto negative = _mm_cmpgt_epi64(zero, delta);
+        delta = _mm_sub_epi64(_mm_xor_si128(delta, negative), negative);
+
+        errors = _mm_sub_epi64(errors, _mm_cmpgt_epi64(delta, limit));
+        min = _mm_blendv_epi8(min, delta, _mm_cmpgt_epi64(min, delta));
+        max = _mm_blendv_epi8(max, delta, _mm_cmpgt_epi64(delta, max));
+    }
+
+    alignas(16) int64_t mins[2], maxs[2], errs[2];
+    _mm_store_si128((__m128i*)mins, min);
+    _mm_store_si128((__m128i*)maxs, max);
+    _mm_store_si128((__m128i*)errs, errors);
+
+    auto d = Scalar(a + i, b + i, count - i, lookahead);
+    for (size_t l = 0; l < 2; ++l) {
+        d.min = std::min(d.min, mins[l]);
+        d.max = std::max(d.max, maxs[l]);
+        d.errors += errs[l];
+    }
+
+    return d;
+}
+#endif
+
+using Kernel = Deltas (*)(int64_t const*, int64_t const*, size_t, int64_t);
+
+struct Implementation {
+    Kernel kernel;
+    char const* name;
+};
+
+Implementation Select() {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return { Avx2, "avx2" };
+    if (__builtin_cpu_supports("sse4.2"))
+        return { Sse42, "sse4.2" };
+#endif
+    return { Scalar, "scalar" };
+}
+
+Implementation const& Selected() {
+    static const Implementation i = Select();
+    return i;
+}
+
+}  // namespace
+
+Deltas Distance(int64_t const* a, int64_t const* b, size_t count, int64_t lookahead) {
+    return Selected().kernel(a, b, count, lookahead);
+}
+
+char const* Name() {
+    return Selected().name;
+}
+
+}  // namespace simd
@@ -0,0 +1,54 @@
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace snapshot {
+
+MappedFile::MappedFile(std::string const& path) {
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (0 == fstat(fd, &st) && st.st_size > 0) {
+        auto p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            data = p;
+            size = size_t(st.st_size);
+        }
+    }
+
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data)
+        munmap(data, size);
+}
+
+Header const* Validate(MappedFile const& file) {
+    if (file.Size() < sizeof(Header))
+        return nullptr;
+
+    auto h = reinterpret_cast<Header const*>(file.Data());
+    if (!std::equal(std::begin(magic), std::end(magic), h->magic) || h->version != version || h->header_size != sizeof(Header))
+        return nullptr;
+
+    if (h->prediction_size != PredictionSize(h->pf_list_size) || h->record_size != RecordSize(h->max_stamps))
+        return nullptr;
+
+    //sections shall fit the file (and not overflow)
+    auto remaining = file.Size() - sizeof(Header);
+    if (h->predictions > remaining / h->prediction_size)
+        return nullptr;
+
+    remaining -= h->predictions * h->prediction_size;
+    return h->records <= remaining / h->record_size ? h : nullptr;
+}
+
+}  // namespace snapshot
@@ -0,0 +1,63 @@
+/* Prefetches of associations mined from rows w/ a single stamp ('min_support' 1) are issued 'prefetch_lead'
+   requests before their target is read, rather than held in the delay queue */
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "pred_utils.h"
+#include "sharded_cache.h"
+
+namespace {
+constexpr size_t block = 4096;
+constexpr size_t pairs = 1000;   //of a source and its target, each is read once per pass
+constexpr size_t checked = 50;   //pairs of the second pass, whose prefetches fit the delay queue anyway
+constexpr size_t gap = 7;        //unrelated requests between a source and its target
+constexpr size_t lead = 4;
+
+size_t Hits(std::vector<std::future<Response>> res) {
+    size_t hits = 0;
+    for (auto& f : res)
+        hits += std::get<cache::Hits>(f.get()).val;
+    return hits;
+}
+}  // namespace
+
+int main() {
+    auto par = PredictorUtils::get_predictor_params(params_cases::Counter_MinModul);
+    par.pf_list_size = gap + 1;  //the target is the weakest association of a source
+    par.prefetch_table_num_rows = 100000;
+    par.record_table_num_rows = 20000;
+
+    //cache is smaller than a pass, so a target is a hit only if it's prefetched
+    ShardedCache cache(CacheType::LRU, PrefetchPolicy::Always, PredictorType::DBSP, 0, 1ull << 40, lead);
+    cache.Init(CacheParams{ 1024 * block, block, block }, par, false);
+
+    std::mt19937_64 g(1);
+    std::vector<size_t> addr(2 * pairs);
+    for (auto& a : addr)
+        a = (g() % (1 << 20)) * 64 * block;
+
+    auto read = [&](size_t a) {
+        return Hits(cache.Process(Request{ a, block, 0, OperationType::Read }));
+    };
+
+    size_t hits = 0;
+    for (size_t pass = 0; pass < 2; ++pass)
+        for (size_t i = 0; i < pairs; ++i) {
+            read(addr[2 * i]);
+            for (size_t k = 0; k < gap; ++k)
+                read((g() % (1ull << 28)) * block + (1ull << 40));
+
+            auto h = read(addr[2 * i + 1]);
+            if (pass && i < checked)
+                hits += h;
+        }
+
+    if (hits < checked * 9 / 10) {
+        std::cerr << "FAILED: " << hits << " of " << checked << " targets are prefetched in time\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
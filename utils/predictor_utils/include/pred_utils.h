@@ -1,6 +1,8 @@
 #include <common.h>
 #include <ipredictor.h>
 
+#include <stdexcept>
+
 enum params_cases {
     UnitTestCase,
     OriginalPaperCase,
@@ -75,7 +77,12 @@ inline PredictorParams get_predictor_params(params_cases c) {
         param.dfs = 1;
         break;
 
+    case params_cases::Counter_Module:
     case params_cases::Counter_NormalizedModul:
+    case params_cases::Counter_MinModul:
+    case params_cases::Counter_Square:
+    case params_cases::Counter_NormalizedSquare:
+    case params_cases::Counter_MinSquare:
         param.lookahead_range = 20;
         param.max_support = 20;
         param.min_support = 1;
@@ -89,7 +96,8 @@ inline PredictorParams get_predictor_params(params_cases c) {
         param.thread_count = 0;
         param.algo = PredictorAlgo::PredictorAlgoAuto;
         param.ts_type = TimeStamp::DoubleCounter;
-        param.associations_metrics_type = Metrics::NormalizedModul;
+        // 'Counter_*' cases follow 'Metrics' order
+        param.associations_metrics_type = Metrics(Metrics::Module + (c - params_cases::Counter_Module));
         param.is_priority_queue = true;
         param.dfs = 1;
         break;